@@ -0,0 +1,209 @@
+#include "backup.h"
+
+using namespace CipherSafe;
+
+const char* Backup::FILE_PREFIX = "ciphersafe-";
+const char* Backup::FILE_SUFFIX = ".enc";
+
+// pages copied per backup step; the source is only locked while a step runs.
+static const int PAGES_PER_STEP = 256;
+
+/*
+ * down to the millisecond so the backup at unlock and a "Backup now" right
+ * after it don't end up with the same name (the second rename would replace
+ * the first). names still sort oldest first.
+ */
+static std::string backup_filename(const std::string& backup_dir) {
+    std::string dir = backup_dir.back() == '/' ? backup_dir : backup_dir + "/";
+
+    for (;;) {
+        auto now = std::chrono::system_clock::now();
+        std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+        long millis = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+
+        struct tm local;
+        char stamp[32];
+        localtime_r(&seconds, &local);
+        size_t length = std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        std::snprintf(stamp + length, sizeof(stamp) - length, "-%03ld", millis);
+
+        std::string filename = dir + Backup::FILE_PREFIX + stamp + Backup::FILE_SUFFIX;
+        struct stat existing;
+        if (stat(filename.c_str(), &existing) != 0) {
+            return filename;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static bool is_backup_file(const std::string& name) {
+    const std::string prefix = Backup::FILE_PREFIX;
+    const std::string suffix = Backup::FILE_SUFFIX;
+
+    return name.size() > prefix.size() + suffix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+Backup::Backup(Crypt& crypt, const std::function<void()>& wake): crypt(crypt), wake(wake), running(false) {}
+
+Backup::~Backup() {
+    Wait();
+}
+
+bool Backup::Start(const std::string& vault_path, const std::string& backup_dir, int retention) {
+    if (this->running) {
+        return false;
+    }
+
+    // the previous worker is finished, but still has to be joined.
+    Wait();
+
+    this->running = true;
+    this->worker = std::thread(&Backup::run, this, vault_path, backup_dir, std::max(1, retention));
+
+    return true;
+}
+
+bool Backup::Running() const {
+    return this->running;
+}
+
+void Backup::Wait() {
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+}
+
+bool Backup::Poll(std::string& message) {
+    std::lock_guard<std::mutex> lock(this->result_mutex);
+
+    if (!this->has_result) {
+        return false;
+    }
+
+    message = this->result;
+    this->has_result = false;
+    return true;
+}
+
+void Backup::finish(const std::string& message) {
+    std::cout << message << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(this->result_mutex);
+        this->result = message;
+        this->has_result = true;
+        this->running = false;
+    }
+
+    if (this->wake) {
+        this->wake();
+    }
+}
+
+void Backup::run(const std::string& vault_path, const std::string& backup_dir, int retention) {
+    std::vector<unsigned char> image;
+    std::string error;
+
+    mkdir(backup_dir.c_str(), 0700);
+
+    if (!snapshot(vault_path, image, error)) {
+        finish("backup failed: " + error + "...");
+        return;
+    }
+
+    std::string filename = backup_filename(backup_dir);
+    bool did_write = this->crypt.encrypt_to_file(image.data(), image.size(), filename);
+    sodium_memzero(image.data(), image.size());
+
+    if (!did_write) {
+        finish("backup failed: couldn't write " + filename + "...");
+        return;
+    }
+
+    prune(backup_dir, retention);
+    finish("backed up the vault to " + filename + "...");
+}
+
+bool Backup::snapshot(const std::string& vault_path, std::vector<unsigned char>& image, std::string& error) {
+    sqlite3* source = nullptr;
+    sqlite3* copy = nullptr;
+
+    // the page key is already registered for vault_path by the Database that has it open.
+    int rc = sqlite3_open_v2(vault_path.c_str(), &source, SQLITE_OPEN_READONLY, EncryptedVFS::NAME);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_open(":memory:", &copy);
+    }
+
+    sqlite3_backup* backup = rc == SQLITE_OK ? sqlite3_backup_init(copy, "main", source, "main") : nullptr;
+
+    if (backup == nullptr) {
+        error = sqlite3_errmsg(copy != nullptr ? copy : source);
+        sqlite3_close(copy);
+        sqlite3_close(source);
+        return false;
+    }
+
+    /*
+     * if the UI commits between two steps the backup notices and starts over
+     * from the first page, so whatever finishes is a consistent snapshot.
+     */
+    do {
+        rc = sqlite3_backup_step(backup, PAGES_PER_STEP);
+
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        } else if (rc == SQLITE_OK) {
+            std::this_thread::yield();
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    sqlite3_backup_finish(backup);
+
+    if (rc == SQLITE_DONE) {
+        sqlite3_int64 size = 0;
+        unsigned char* data = sqlite3_serialize(copy, "main", &size, 0);
+
+        if (data != nullptr) {
+            image.assign(data, data + size);
+            sodium_memzero(data, static_cast<size_t>(size));
+            sqlite3_free(data);
+        } else {
+            rc = SQLITE_NOMEM;
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        error = sqlite3_errstr(rc);
+    }
+
+    sqlite3_close(copy);
+    sqlite3_close(source);
+
+    return rc == SQLITE_DONE;
+}
+
+void Backup::prune(const std::string& backup_dir, int retention) {
+    DIR* dir = opendir(backup_dir.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    std::vector<std::string> backups;
+    while (struct dirent* entry = readdir(dir)) {
+        if (is_backup_file(entry->d_name)) {
+            backups.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    // the timestamp in the name sorts oldest first.
+    std::sort(backups.begin(), backups.end());
+
+    std::string prefix = backup_dir.back() == '/' ? backup_dir : backup_dir + "/";
+    for (size_t i = 0; i + retention < backups.size(); i++) {
+        std::remove((prefix + backups[i]).c_str());
+    }
+}
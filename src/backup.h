@@ -0,0 +1,64 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "crypt.h"
+#include "encrypted_vfs.h"
+
+namespace CipherSafe {
+
+  /*
+   * takes encrypted snapshots of the vault on a background thread.
+   *
+   * the snapshot is read through a separate read-only connection with the
+   * online backup API, a few pages at a time, so the UI's connection can
+   * keep committing in between. it then goes through Crypt into
+   * backup_dir/ciphersafe-<date>-<time>-<ms>.enc (same container format as
+   * core.enc), and only the newest `retention` backups are kept.
+   */
+  class Backup {
+  public:
+    // `wake` is called from the backup thread once a result is waiting for Poll().
+    explicit Backup(Crypt& crypt, const std::function<void()>& wake = nullptr);
+    ~Backup();
+
+    // false if a backup is already running.
+    bool Start(const std::string& vault_path, const std::string& backup_dir, int retention);
+    bool Running() const;
+    // blocks until a running backup is done.
+    void Wait();
+
+    // true once per finished backup, with a message fit for the console.
+    bool Poll(std::string& message);
+
+    static const char* FILE_PREFIX;
+    static const char* FILE_SUFFIX;
+
+  private:
+    Crypt& crypt;
+    std::function<void()> wake;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::mutex result_mutex;
+    bool has_result = false;
+    std::string result;
+
+    void run(const std::string& vault_path, const std::string& backup_dir, int retention);
+    bool snapshot(const std::string& vault_path, std::vector<unsigned char>& image, std::string& error);
+    void prune(const std::string& backup_dir, int retention);
+    void finish(const std::string& message);
+  };
+}
+#endif
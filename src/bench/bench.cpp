@@ -0,0 +1,448 @@
+#include "../database.h"
+#include "../crypt.h"
+#include "../fuzzy_matcher.h"
+#include <chrono>
+#include <random>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * CipherSafeBench: times the database, crypto and search hot paths on
+ * synthetic vaults and writes the numbers out as JSON so they can be
+ * compared between releases.
+ *
+ *   ./CipherSafeBench [--sizes 1000,10000,100000] [--ops 1000] [--out bench.json] [--work-dir ./bench_work/]
+ *
+ * --sizes  vault sizes (entries) to run everything against, up to 1000000.
+ * --ops    how many single-row operations (Add, Update, GetEntryById) to time per size.
+ * --out    where the JSON goes. progress is printed to stderr as it runs.
+ */
+
+struct BenchResult {
+    std::string name;
+    size_t entries;     // vault size the number was taken at (0 = doesn't depend on it)
+    double amount;      // work done, in `unit`s
+    std::string unit;   // "ops", "rows" or "MB"
+    double seconds;
+};
+
+struct BenchOptions {
+    std::vector<size_t> sizes = { 1000, 10000, 100000 };
+    size_t ops = 1000;
+    std::string out = "bench.json";
+    std::string work_dir = "./bench_work/";
+};
+
+static const char* WORDS[] = {
+    "mail", "bank", "git", "cloud", "shop", "news", "work", "home",
+    "music", "video", "travel", "games", "forum", "photo", "chat", "docs",
+};
+static const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static const char* CATEGORIES[] = { "email", "finance", "dev", "social", "shopping", "work", "media", "misc" };
+static const size_t CATEGORY_COUNT = sizeof(CATEGORIES) / sizeof(CATEGORIES[0]);
+
+// queries shaped like what gets typed into the search box: broad, narrow and no hits.
+static const char* QUERIES[] = { "m", "ba", "bank", "git 42", "example", "zzzz" };
+static const size_t QUERY_COUNT = sizeof(QUERIES) / sizeof(QUERIES[0]);
+
+static std::vector<BenchResult> results;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void record(const std::string& name, size_t entries, double amount, const std::string& unit, double seconds) {
+    results.push_back({ name, entries, amount, unit, seconds });
+    std::cerr << "  " << name << ": " << amount / seconds << " " << unit << "/s" << std::endl;
+}
+
+/*
+ * runs `work` until at least min_seconds have passed (and at least once),
+ * for calls too quick to time one by one.
+ */
+static void repeatFor(double min_seconds, const std::function<void()>& work, size_t& runs, double& seconds) {
+    auto start = std::chrono::steady_clock::now();
+    runs = 0;
+
+    do {
+        work();
+        runs++;
+        seconds = secondsSince(start);
+    } while (seconds < min_seconds);
+}
+
+static CipherSafe::Database::Entry syntheticEntry(std::mt19937& rng, size_t i) {
+    CipherSafe::Database::Entry entry;
+    std::string word = WORDS[rng() % WORD_COUNT];
+
+    entry.id       = 0;
+    entry.title    = word + " " + WORDS[rng() % WORD_COUNT] + " " + std::to_string(i);
+    entry.url      = "https://" + word + std::to_string(i) + ".example.com/login";
+    entry.username = "user" + std::to_string(rng() % 100000) + "@example.com";
+    entry.password = CipherSafe::Crypt::random_string(20);
+    entry.category = CATEGORIES[rng() % CATEGORY_COUNT];
+    entry.notes    = std::string(rng() % 200, 'n');
+
+    return entry;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+static bool writeJson(const BenchOptions& options) {
+    std::ofstream file(options.out);
+    std::ostream* out = &file;
+
+    if (!file.is_open()) {
+        std::cerr << "failed to open " << options.out << " for writing." << std::endl;
+        return false;
+    }
+
+    *out << "{\n";
+    *out << "  \"benchmark\": \"CipherSafeBench\",\n";
+    *out << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+    *out << "  \"sqlite_version\": \"" << sqlite3_libversion() << "\",\n";
+    *out << "  \"sodium_version\": \"" << sodium_version_string() << "\",\n";
+    *out << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        *out << "    { \"name\": \"" << jsonEscape(r.name) << "\""
+             << ", \"entries\": " << r.entries
+             << ", \"amount\": " << r.amount
+             << ", \"unit\": \"" << r.unit << "\""
+             << ", \"seconds\": " << r.seconds
+             << ", \"per_second\": " << (r.seconds > 0 ? r.amount / r.seconds : 0)
+             << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    *out << "  ]\n";
+    *out << "}\n";
+
+    return out->good();
+}
+
+static void removeVault(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-journal").c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+static void benchDatabase(const BenchOptions& options, size_t size, std::vector<unsigned char>& image) {
+    std::mt19937 rng(static_cast<unsigned int>(size));
+
+    // build the synthetic vault in memory first, that's also the fastest way to seed the on-disk one.
+    std::vector<CipherSafe::Database::Entry> synthetic;
+    synthetic.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        synthetic.push_back(syntheticEntry(rng, i));
+    }
+
+    std::unique_ptr<CipherSafe::Database> memory(new CipherSafe::Database(std::vector<unsigned char>()));
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& entry : synthetic) {
+        memory->Add(std::unique_ptr<CipherSafe::Database::Entry>(new CipherSafe::Database::Entry(entry)));
+    }
+    record("database.add.in_memory", size, size, "ops", secondsSince(start));
+
+    memory->Serialize([&image](const unsigned char* data, size_t length) {
+        image.assign(data, data + length);
+        return true;
+    });
+    memory->Close();
+
+    const std::string vault_path = options.work_dir + "bench.vault";
+    removeVault(vault_path);
+
+    unsigned char page_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+    randombytes_buf(page_key, sizeof(page_key));
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, page_key));
+    sodium_memzero(page_key, sizeof(page_key));
+
+    start = std::chrono::steady_clock::now();
+    db->Import(image);
+    record("database.import", size, size, "ops", secondsSince(start));
+
+    const std::string batch_path = options.work_dir + "batch.vault";
+    removeVault(batch_path);
+
+    randombytes_buf(page_key, sizeof(page_key));
+    std::unique_ptr<CipherSafe::Database> batch(new CipherSafe::Database(batch_path, page_key));
+    sodium_memzero(page_key, sizeof(page_key));
+
+    start = std::chrono::steady_clock::now();
+    batch->AddBatch(synthetic);
+    record("database.add_batch", size, size, "ops", secondsSince(start));
+
+    batch->Close();
+    removeVault(batch_path);
+
+    // single row writes are one durable commit each.
+    size_t ops = std::min(options.ops, size);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        CipherSafe::Database::Entry entry = syntheticEntry(rng, size + i);
+        db->Add(std::unique_ptr<CipherSafe::Database::Entry>(new CipherSafe::Database::Entry(entry)));
+    }
+    record("database.add", size, ops, "ops", secondsSince(start));
+
+    std::vector<int> ids;
+    for (const auto& entry : db->Entries()) {
+        ids.push_back(entry.id);
+    }
+
+    std::vector<CipherSafe::Database::Entry> updates;
+    for (size_t i = 0; i < ops; i++) {
+        updates.push_back(*db->CachedEntry(ids[rng() % ids.size()]));
+        updates.back().password = CipherSafe::Crypt::random_string(20);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (auto& entry : updates) {
+        db->Update(&entry);
+    }
+    record("database.update", size, ops, "ops", secondsSince(start));
+
+    // only the password changes, so unlike Update() the search index isn't touched.
+    for (auto& entry : updates) {
+        entry.password = CipherSafe::Crypt::random_string(20);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (auto& entry : updates) {
+        db->UpdateFields(entry, CipherSafe::Database::FIELD_PASSWORD);
+    }
+    record("database.update_fields", size, ops, "ops", secondsSince(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        db->GetEntryById(ids[rng() % ids.size()]);
+    }
+    record("database.get_entry_by_id", size, ops, "ops", secondsSince(start));
+
+    size_t runs = 0;
+    size_t rows = 0;
+    double seconds = 0;
+
+    repeatFor(0.25, [&]() { rows += db->GetAll().size(); }, runs, seconds);
+    record("database.get_all", size, rows, "rows", seconds);
+
+    for (size_t q = 0; q < QUERY_COUNT; q++) {
+        repeatFor(0.1, [&]() { db->Filter(QUERIES[q]); }, runs, seconds);
+        record(std::string("database.filter[") + QUERIES[q] + "]", size, runs, "ops", seconds);
+
+        repeatFor(0.1, [&]() { db->Search(QUERIES[q]); }, runs, seconds);
+        record(std::string("database.search[") + QUERIES[q] + "]", size, runs, "ops", seconds);
+    }
+
+    db->Close();
+    removeVault(vault_path);
+}
+
+/*
+ * the same single row commits under each storage profile, on an encrypted
+ * vault of this size: what each step down in durability buys in latency.
+ */
+static void benchStorage(const BenchOptions& options, size_t size, const std::vector<unsigned char>& image) {
+    const char* profiles[] = { "safe", "balanced", "fast" };
+    const std::string vault_path = options.work_dir + "storage.vault";
+    size_t ops = std::min(options.ops, size);
+    std::mt19937 rng(static_cast<unsigned int>(size));
+
+    for (const char* profile : profiles) {
+        removeVault(vault_path);
+
+        unsigned char page_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+        randombytes_buf(page_key, sizeof(page_key));
+        std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, page_key, CipherSafe::Database::StorageProfile(profile)));
+        sodium_memzero(page_key, sizeof(page_key));
+
+        db->Import(image);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; i++) {
+            CipherSafe::Database::Entry entry = syntheticEntry(rng, size + i);
+            db->Add(std::unique_ptr<CipherSafe::Database::Entry>(new CipherSafe::Database::Entry(entry)));
+        }
+        record(std::string("database.add.") + profile, size, ops, "ops", secondsSince(start));
+
+        std::vector<CipherSafe::Database::Entry> updates;
+        for (size_t i = 0; i < ops; i++) {
+            updates.push_back(db->Entries()[rng() % db->Entries().size()]);
+            updates.back().password = CipherSafe::Crypt::random_string(20);
+        }
+
+        start = std::chrono::steady_clock::now();
+        for (auto& entry : updates) {
+            db->UpdateFields(entry, CipherSafe::Database::FIELD_PASSWORD);
+        }
+        record(std::string("database.update_fields.") + profile, size, ops, "ops", secondsSince(start));
+
+        db->Close();
+    }
+
+    removeVault(vault_path);
+}
+
+/*
+ * fuzzy matching over the whole vault, typos included. the table runs it on
+ * the UI thread, so at 100000 entries a search has to stay under a frame
+ * (16ms, i.e. above 62 ops/s).
+ */
+static void benchFuzzy(size_t size, const std::vector<unsigned char>& image) {
+    const char* queries[] = { "m", "bank", "gthub", "clodu", "mail example" };
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(image));
+
+    CipherSafe::FuzzyMatcher matcher;
+    size_t runs = 0;
+    double seconds = 0;
+
+    repeatFor(0.25, [&]() { matcher.Build(db->Entries()); }, runs, seconds);
+    record("fuzzy.build", size, runs * size, "rows", seconds);
+
+    for (const char* query : queries) {
+        repeatFor(0.1, [&]() { matcher.Search(query, 100); }, runs, seconds);
+        record(std::string("fuzzy.search.") + CipherSafe::FuzzyMatcher::Kernel() + "[" + query + "]", size, runs, "ops", seconds);
+    }
+
+    db->Close();
+}
+
+// both I/O backends over the same image, so the mapped path can be compared with the buffered one.
+static void benchCrypt(const BenchOptions& options, size_t size, const std::vector<unsigned char>& image) {
+    const std::string plain_path = options.work_dir + "core.db";
+    const double megabytes = image.size() / (1024.0 * 1024.0);
+
+    CipherSafe::Crypt crypt;
+    crypt.init(options.work_dir);
+    if (!crypt.has_master_password()) {
+        crypt.create_master_password("bench", CipherSafe::Crypt::kdf_profile("interactive"));
+    }
+
+    std::ofstream plain_file(plain_path, std::ios::binary);
+    plain_file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    plain_file.close();
+
+    const std::pair<CipherSafe::Crypt::IoBackend, const char*> backends[] = {
+        std::make_pair(CipherSafe::Crypt::IO_BUFFERED, "buffered"),
+        std::make_pair(CipherSafe::Crypt::IO_MMAP, "mmap"),
+    };
+
+    for (const auto& backend : backends) {
+        crypt.set_io_backend(backend.first);
+
+        auto start = std::chrono::steady_clock::now();
+        crypt.encrypt_file();
+        record(std::string("crypt.encrypt_file.") + backend.second, size, megabytes, "MB", secondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        crypt.decrypt_file();
+        record(std::string("crypt.decrypt_file.") + backend.second, size, megabytes, "MB", secondsSince(start));
+    }
+
+    std::remove(plain_path.c_str());
+    std::remove((options.work_dir + "core.enc").c_str());
+}
+
+static void benchRandomString() {
+    const size_t count = 100000;
+    size_t total = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        total += CipherSafe::Crypt::random_string(32).size();
+    }
+    double seconds = secondsSince(start);
+
+    record("crypt.random_string", 0, count, "ops", seconds);
+    record("crypt.random_string.bytes", 0, total / (1024.0 * 1024.0), "MB", seconds);
+}
+
+// one master password unlock per profile: how long users wait at the unlock screen.
+static void benchKdf() {
+    const char* profiles[] = { "interactive", "moderate", "sensitive" };
+
+    for (const char* profile : profiles) {
+        double seconds = CipherSafe::Crypt::time_kdf(CipherSafe::Crypt::kdf_profile(profile));
+        record(std::string("crypt.kdf.") + profile, 0, 1, "ops", seconds);
+    }
+}
+
+static bool parseArgs(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << std::endl;
+            return false;
+        }
+
+        std::string value = argv[++i];
+
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            std::stringstream list(value);
+            std::string size;
+            while (std::getline(list, size, ',')) {
+                options.sizes.push_back(std::stoul(size));
+            }
+        } else if (arg == "--ops") {
+            options.ops = std::stoul(value);
+        } else if (arg == "--out") {
+            options.out = value;
+        } else if (arg == "--work-dir") {
+            options.work_dir = value.back() == '/' ? value : value + "/";
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+
+    if (!parseArgs(argc, argv, options)) {
+        std::cerr << "usage: CipherSafeBench [--sizes 1000,10000,100000] [--ops 1000] [--out bench.json] [--work-dir ./bench_work/]" << std::endl;
+        return 1;
+    }
+
+    mkdir(options.work_dir.c_str(), 0700);
+
+    benchRandomString();
+    benchKdf();
+
+    for (size_t size : options.sizes) {
+        std::cerr << "vault with " << size << " entries:" << std::endl;
+
+        std::vector<unsigned char> image;
+        benchDatabase(options, size, image);
+        benchStorage(options, size, image);
+        benchFuzzy(size, image);
+        benchCrypt(options, size, image);
+    }
+
+    std::remove((options.work_dir + "core.vault.key").c_str());
+    rmdir(options.work_dir.c_str());
+
+    return writeJson(options) ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include "category_index.h"
+
+using namespace CipherSafe;
+
+void CategoryIndex::Clear() {
+    this->categories.clear();
+}
+
+void CategoryIndex::Add(int id, const std::string& category) {
+    std::vector<int>& ids = this->categories[category];
+
+    // new entries have the highest id yet, so this is nearly always a push_back.
+    if (ids.empty() || ids.back() < id) {
+        ids.push_back(id);
+        return;
+    }
+
+    auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+    if (pos == ids.end() || *pos != id) {
+        ids.insert(pos, id);
+    }
+}
+
+void CategoryIndex::Remove(int id, const std::string& category) {
+    auto it = this->categories.find(category);
+    if (it == this->categories.end()) {
+        return;
+    }
+
+    std::vector<int>& ids = it->second;
+    auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+    if (pos != ids.end() && *pos == id) {
+        ids.erase(pos);
+    }
+
+    if (ids.empty()) {
+        this->categories.erase(it);
+    }
+}
+
+void CategoryIndex::Move(int id, const std::string& from, const std::string& to) {
+    if (from == to) {
+        return;
+    }
+
+    Remove(id, from);
+    Add(id, to);
+}
+
+size_t CategoryIndex::Count(const std::string& category) const {
+    auto it = this->categories.find(category);
+    return it != this->categories.end() ? it->second.size() : 0;
+}
+
+const std::vector<int>* CategoryIndex::Ids(const std::string& category) const {
+    auto it = this->categories.find(category);
+    return it != this->categories.end() ? &it->second : nullptr;
+}
+
+const CategoryIndex::Map& CategoryIndex::Categories() const {
+    return this->categories;
+}
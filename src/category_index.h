@@ -0,0 +1,38 @@
+#ifndef CATEGORY_INDEX_H
+#define CATEGORY_INDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace CipherSafe {
+
+  /*
+   * entry ids grouped by category, kept up to date one entry at a time by
+   * whoever owns the entries (Database, DatabaseWorker's mirror), so browsing
+   * a category is a lookup instead of a scan of the vault. categories are
+   * the exact text of Entry::category, "" included, and go away with their
+   * last entry.
+   */
+  class CategoryIndex {
+  public:
+    typedef std::map<std::string, std::vector<int>> Map;
+
+    void Clear();
+    void Add(int id, const std::string& category);
+    void Remove(int id, const std::string& category);
+    // an entry's category changed from `from` to `to`.
+    void Move(int id, const std::string& from, const std::string& to);
+
+    size_t Count(const std::string& category) const;
+    // ids in that category in id order, nullptr if there are none.
+    const std::vector<int>* Ids(const std::string& category) const;
+    // every category in name order, with its ids.
+    const Map& Categories() const;
+
+  private:
+    Map categories;
+  };
+}
+#endif
@@ -2,190 +2,874 @@
 
 using namespace CipherSafe;
 
+static const char CONTAINER_MAGIC[8] = { 'C', 'S', 'A', 'F', 'E', 'v', '2', '\0' };
+static const uint32_t CONTAINER_VERSION = 2;
+static const size_t CONTAINER_HEADER_BYTES = 32;
+static const size_t CONTAINER_CHUNK_SIZE = 1024 * 1024;
+static const size_t CONTAINER_RECORD_BYTES =
+    crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + CONTAINER_CHUNK_SIZE + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+
+static void store_u32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static void store_u64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static uint32_t load_u32(const unsigned char* in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t load_u64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static const char KEY_HEADER_MAGIC[8] = { 'C', 'S', 'K', 'E', 'Y', 'v', '1', '\0' };
+static const uint32_t KEY_HEADER_VERSION = 1;
+static const size_t KEY_HEADER_AD_BYTES = 32 + crypto_pwhash_SALTBYTES;
+static const size_t KEY_HEADER_BYTES = KEY_HEADER_AD_BYTES + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES +
+    crypto_secretstream_xchacha20poly1305_KEYBYTES + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+
+// calibration never goes past these, whatever the target.
+static const unsigned long long KDF_MAX_CALIBRATED_OPSLIMIT = 4 * crypto_pwhash_OPSLIMIT_SENSITIVE;
+static const size_t KDF_MAX_CALIBRATED_MEMLIMIT = crypto_pwhash_MEMLIMIT_SENSITIVE;
+
+static uint64_t container_chunk_count(uint64_t plain_size) {
+    // an empty file still gets one (empty) chunk so the header is always authenticated.
+    return std::max<uint64_t>(1, (plain_size + CONTAINER_CHUNK_SIZE - 1) / CONTAINER_CHUNK_SIZE);
+}
+
+static size_t container_chunk_length(uint64_t index, uint64_t plain_size) {
+    uint64_t offset = index * CONTAINER_CHUNK_SIZE;
+    return static_cast<size_t>(std::min<uint64_t>(CONTAINER_CHUNK_SIZE, plain_size - std::min(offset, plain_size)));
+}
+
+// only the last chunk can be short, so every record starts at a fixed offset.
+static uint64_t container_size(uint64_t plain_size) {
+    uint64_t chunk_count = container_chunk_count(plain_size);
+    return CONTAINER_HEADER_BYTES + (chunk_count - 1) * CONTAINER_RECORD_BYTES +
+        crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + container_chunk_length(chunk_count - 1, plain_size) + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+}
+
+/*
+ * runs work(0..count-1) across one worker per core (the calling thread is
+ * one of them) and returns once every item is done.
+ */
+static void parallel_for(size_t count, const std::function<void(size_t)>& work) {
+    size_t worker_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < worker_count; i++) {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+static bool read_whole_file(const std::string& filename, std::vector<unsigned char>& data) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+    return file.good() || data.empty();
+}
+
+/*
+ * a whole input file, mapped (no copy: pages come out of the page cache as
+ * the workers touch them) or read into a buffer.
+ */
+class FileView {
+public:
+    FileView() {}
+
+    ~FileView() {
+        if (this->mapping != nullptr) {
+            munmap(this->mapping, this->length);
+        }
+
+        sodium_memzero(this->buffer.data(), this->buffer.size());
+    }
+
+    bool open(const std::string& filename, bool mapped) {
+        if (!mapped) {
+            if (!read_whole_file(filename, this->buffer)) {
+                return false;
+            }
+
+            this->bytes = this->buffer.data();
+            this->length = this->buffer.size();
+            return true;
+        }
+
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            return false;
+        }
+
+        this->length = static_cast<size_t>(info.st_size);
+
+        // mmap() refuses empty files, and there is nothing to map anyway.
+        if (this->length > 0) {
+            void* mapping = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+
+            // every chunk gets read, start reading ahead for all of them.
+            madvise(mapping, this->length, MADV_WILLNEED);
+            this->mapping = mapping;
+            this->bytes = static_cast<const unsigned char*>(mapping);
+        }
+
+        close(fd);
+        return true;
+    }
+
+    const unsigned char* data() const {
+        return this->bytes;
+    }
+
+    size_t size() const {
+        return this->length;
+    }
+
+private:
+    FileView(const FileView&);
+    FileView& operator=(const FileView&);
+
+    std::vector<unsigned char> buffer;
+    void* mapping = nullptr;
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
+
+static bool file_exists(const std::string& filename) {
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0;
+}
+
+static bool write_all(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (written <= 0) {
+            return false;
+        }
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+// makes a rename inside the directory durable.
+static void sync_parent_dir(const std::string& filename) {
+    size_t slash = filename.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/*
+ * the blocks have to exist before a mapping of the file is written: running
+ * out of disk space halfway through a mapped write is a SIGBUS, not an error.
+ */
+static bool reserve_blocks(int fd, size_t size) {
+#ifdef __linux__
+    return posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+#else
+    (void)fd;
+    (void)size;
+    return false;
+#endif
+}
+
+static bool write_mapped(int fd, size_t size, const std::function<void(unsigned char*)>& fill) {
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    fill(static_cast<unsigned char*>(mapping));
+
+    bool synced = msync(mapping, size, MS_SYNC) == 0;
+    munmap(mapping, size);
+
+    return synced;
+}
+
+static bool write_buffered(int fd, size_t size, const std::function<void(unsigned char*)>& fill) {
+    std::vector<unsigned char> buffer(size);
+    fill(buffer.data());
+
+    bool written = write_all(fd, buffer.data(), buffer.size());
+    sodium_memzero(buffer.data(), buffer.size());
+
+    return written;
+}
+
+/*
+ * writes `size` bytes produced by fill() next to `filename`, fsyncs and
+ * renames over it once complete. a crash at any point leaves either the old
+ * file or the new one, never half of one or neither.
+ */
+static bool write_file_atomically(const std::string& filename, size_t size, bool mapped, const std::function<void(unsigned char*)>& fill) {
+    const std::string temp_filename = filename + ".tmp";
+
+    int fd = open(temp_filename.c_str(), (mapped ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool written;
+    if (mapped && size > 0 && reserve_blocks(fd, size)) {
+        written = write_mapped(fd, size, fill);
+    } else {
+        written = ftruncate(fd, 0) == 0 && write_buffered(fd, size, fill);
+    }
+
+    // the data has to be on disk before the rename makes it the only copy.
+    written = written && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+
+    if (!written || std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+        std::remove(temp_filename.c_str());
+        return false;
+    }
+
+    sync_parent_dir(filename);
+    return true;
+}
+
+static bool write_file_atomically(const std::string& filename, const unsigned char* data, size_t size) {
+    return write_file_atomically(filename, size, false, [data, size](unsigned char* out) {
+        std::memcpy(out, data, size);
+    });
+}
+
+// a quarter of the RAM, so calibrating on a small machine doesn't push everything else into swap.
+static size_t kdf_memory_budget() {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGE_SIZE);
+
+    if (pages <= 0 || page_size <= 0) {
+        return KDF_MAX_CALIBRATED_MEMLIMIT;
+    }
+
+    return std::min<uint64_t>(KDF_MAX_CALIBRATED_MEMLIMIT, static_cast<uint64_t>(pages) * page_size / 4);
+}
+
 Crypt::Crypt() {
     if (sodium_init() < 0) {
         std::cerr << "libsodium couldn't be initialized." << std::endl; 
         exit(1);
     }
+
+    sodium_mlock(m_key, sizeof(m_key));
+}
+
+Crypt::~Crypt() {
+    // sodium_munlock() wipes the key before unlocking it.
+    sodium_munlock(m_key, sizeof(m_key));
 }
 
 void Crypt::init(const std::string& path) {
     work_dir = path;
     std::cout << "current work_dir: " << work_dir << std::endl;
 
-    const std::string key_file    = work_dir + ".encryption_key.bin";
-    const std::string header_file = work_dir + ".encryption_header.bin";
+    std::cout << "key header path: " << work_dir + m_key_header_filename << std::endl;
+
+    // older versions kept one secretstream header here and reused it for every save.
+    std::remove((work_dir + ".encryption_header.bin").c_str());
+}
+
+Crypt::KdfParams Crypt::kdf_profile(const std::string& name) {
+    KdfParams params;
+
+    if (name == "interactive") {
+        params.opslimit = crypto_pwhash_OPSLIMIT_INTERACTIVE;
+        params.memlimit = crypto_pwhash_MEMLIMIT_INTERACTIVE;
+    } else if (name == "sensitive") {
+        params.opslimit = crypto_pwhash_OPSLIMIT_SENSITIVE;
+        params.memlimit = crypto_pwhash_MEMLIMIT_SENSITIVE;
+    } else {
+        params.opslimit = crypto_pwhash_OPSLIMIT_MODERATE;
+        params.memlimit = crypto_pwhash_MEMLIMIT_MODERATE;
+    }
+
+    return params;
+}
+
+double Crypt::time_kdf(const KdfParams& params) {
+    const char password[] = "calibration";
+    unsigned char salt[crypto_pwhash_SALTBYTES];
+    unsigned char key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+
+    randombytes_buf(salt, sizeof(salt));
+
+    auto start = std::chrono::steady_clock::now();
+    int result = crypto_pwhash(key, sizeof(key), password, sizeof(password) - 1, salt,
+        params.opslimit, params.memlimit, crypto_pwhash_ALG_ARGON2ID13);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    sodium_memzero(key, sizeof(key));
+
+    // out of memory: as good as infinitely slow.
+    return result == 0 ? elapsed.count() : 1e9;
+}
 
-    std::cout << "key_file path: " << key_file << std::endl;
-    std::cout << "header_file path: " << header_file << std::endl;
+Crypt::KdfParams Crypt::calibrate_kdf(double target_seconds, double* seconds_out) {
+    KdfParams params = kdf_profile("interactive");
+    const size_t memory_budget = kdf_memory_budget();
+    double seconds = time_kdf(params);
 
-    if (!std::ifstream(key_file).good()) {
-        generate_and_store_key(key_file);
+    // memory first, it is what makes guessing on GPUs expensive. argon2 time grows about linearly with it.
+    while (seconds * 2 <= target_seconds && params.memlimit * 2 <= memory_budget) {
+        params.memlimit *= 2;
+        seconds = time_kdf(params);
     }
 
-    if (!std::ifstream(header_file).good()) {
-        generate_and_store_header(header_file);
+    // then passes over that memory, again about linear.
+    if (seconds > 0 && seconds < target_seconds) {
+        double opslimit = std::min<double>(params.opslimit * target_seconds / seconds, KDF_MAX_CALIBRATED_OPSLIMIT);
+        seconds *= static_cast<unsigned long long>(opslimit) / static_cast<double>(params.opslimit);
+        params.opslimit = static_cast<unsigned long long>(opslimit);
     }
 
-    read_key(key_file, m_key);
-    read_header(header_file, m_header);
+    if (seconds_out != nullptr) {
+        *seconds_out = seconds;
+    }
+
+    return params;
+}
+
+bool Crypt::has_master_password() {
+    return file_exists(work_dir + m_key_header_filename);
+}
+
+bool Crypt::unlocked() {
+    return m_unlocked;
+}
+
+double Crypt::unlock_seconds() {
+    return m_unlock_seconds;
+}
+
+bool Crypt::create_master_password(const SecureString& password, const KdfParams& params) {
+    if (has_master_password()) {
+        error_logger("A master password is already set.");
+        return false;
+    }
+
+    // an install from before master passwords keeps its key, so core.vault and core.enc still open.
+    const std::string legacy_key_file = work_dir + m_legacy_key_filename;
+    bool adopt_legacy_key = file_exists(legacy_key_file);
+
+    if (adopt_legacy_key) {
+        if (!read_key(legacy_key_file, m_key)) {
+            sodium_memzero(m_key, sizeof(m_key));
+            return false;
+        }
+    } else {
+        crypto_secretstream_xchacha20poly1305_keygen(m_key);
+    }
+
+    if (!write_key_header(password, params)) {
+        sodium_memzero(m_key, sizeof(m_key));
+        return false;
+    }
+
+    if (adopt_legacy_key) {
+        // the raw key is the only way into the existing vault, it stays until the header is known to give it back.
+        unsigned char check[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+        KdfParams stored;
+        bool verified = read_key_header(password, check, stored) && sodium_memcmp(check, m_key, sizeof(m_key)) == 0;
+        sodium_memzero(check, sizeof(check));
+
+        if (!verified) {
+            error_logger("The wrapped key didn't read back, keeping the old key file.");
+            std::remove((work_dir + m_key_header_filename).c_str());
+            sodium_memzero(m_key, sizeof(m_key));
+            return false;
+        }
+
+        // overwrite the raw key before unlinking it, the wrapped copy is the only one from now on.
+        unsigned char zeros[crypto_secretstream_xchacha20poly1305_KEYBYTES] = { 0 };
+        std::ofstream(legacy_key_file, std::ios::binary | std::ios::in | std::ios::out)
+            .write(reinterpret_cast<const char*>(zeros), sizeof(zeros));
+        std::remove(legacy_key_file.c_str());
+    }
+
+    m_unlocked = true;
+    return true;
+}
+
+bool Crypt::unlock(const SecureString& password, const KdfParams& params) {
+    KdfParams stored;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!read_key_header(password, m_key, stored)) {
+        return false;
+    }
+
+    m_unlocked = true;
+
+    // the unlock itself, the re-wrap below is a one-off that write_key_header() would time instead.
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // the profile changed in the settings since the key was last wrapped. the old header still works if this fails.
+    if (stored.opslimit != params.opslimit || stored.memlimit != params.memlimit) {
+        if (!write_key_header(password, params)) {
+            error_logger("Failed to re-wrap the vault key with the new key derivation settings, keeping the old ones.");
+        }
+    }
+
+    m_unlock_seconds = elapsed.count();
+
+    return true;
+}
+
+bool Crypt::read_key_header(const SecureString& password, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES], KdfParams& stored) {
+    std::vector<unsigned char> header;
+    if (!read_whole_file(work_dir + m_key_header_filename, header) || header.size() != KEY_HEADER_BYTES ||
+            std::memcmp(header.data(), KEY_HEADER_MAGIC, sizeof(KEY_HEADER_MAGIC)) != 0) {
+        error_logger("Missing or corrupted key header.");
+        return false;
+    }
+
+    uint32_t version = load_u32(header.data() + 8);
+    uint32_t alg     = load_u32(header.data() + 12);
+    uint64_t opslimit = load_u64(header.data() + 16);
+    uint64_t memlimit = load_u64(header.data() + 24);
+
+    if (version != KEY_HEADER_VERSION || alg != crypto_pwhash_ALG_ARGON2ID13 ||
+            opslimit < crypto_pwhash_OPSLIMIT_MIN || memlimit < crypto_pwhash_MEMLIMIT_MIN || memlimit > SIZE_MAX) {
+        error_logger("Unsupported key header.");
+        return false;
+    }
+
+    stored.opslimit = opslimit;
+    stored.memlimit = static_cast<size_t>(memlimit);
+
+    const unsigned char* salt    = header.data() + 32;
+    const unsigned char* nonce   = header.data() + KEY_HEADER_AD_BYTES;
+    const unsigned char* wrapped = nonce + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    unsigned char wrapping_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+
+    if (!derive_wrapping_key(password, salt, stored, wrapping_key)) {
+        return false;
+    }
+
+    int result = crypto_aead_xchacha20poly1305_ietf_decrypt(
+        key, nullptr, nullptr,
+        wrapped, crypto_secretstream_xchacha20poly1305_KEYBYTES + crypto_aead_xchacha20poly1305_ietf_ABYTES,
+        header.data(), KEY_HEADER_AD_BYTES, nonce, wrapping_key);
+
+    sodium_memzero(wrapping_key, sizeof(wrapping_key));
+
+    if (result != 0) {
+        // wrong password (or a tampered header).
+        sodium_memzero(key, crypto_secretstream_xchacha20poly1305_KEYBYTES);
+        return false;
+    }
+
+    return true;
+}
+
+bool Crypt::derive_wrapping_key(const SecureString& password, const unsigned char* salt, const KdfParams& params, unsigned char wrapping_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]) {
+    if (crypto_pwhash(wrapping_key, crypto_aead_xchacha20poly1305_ietf_KEYBYTES, password.c_str(), password.size(), salt,
+            params.opslimit, params.memlimit, crypto_pwhash_ALG_ARGON2ID13) != 0) {
+        error_logger("Not enough memory to derive the key from the master password.");
+        return false;
+    }
+
+    return true;
+}
+
+bool Crypt::write_key_header(const SecureString& password, const KdfParams& params) {
+    unsigned char header[KEY_HEADER_BYTES];
+    unsigned char* salt    = header + 32;
+    unsigned char* nonce   = header + KEY_HEADER_AD_BYTES;
+    unsigned char* wrapped = nonce + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    unsigned char wrapping_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+
+    std::memcpy(header, KEY_HEADER_MAGIC, sizeof(KEY_HEADER_MAGIC));
+    store_u32(header + 8, KEY_HEADER_VERSION);
+    store_u32(header + 12, crypto_pwhash_ALG_ARGON2ID13);
+    store_u64(header + 16, params.opslimit);
+    store_u64(header + 24, params.memlimit);
+    randombytes_buf(salt, crypto_pwhash_SALTBYTES);
+    randombytes_buf(nonce, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!derive_wrapping_key(password, salt, params, wrapping_key)) {
+        return false;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    m_unlock_seconds = elapsed.count();
+
+    crypto_aead_xchacha20poly1305_ietf_encrypt(
+        wrapped, nullptr, m_key, sizeof(m_key),
+        header, KEY_HEADER_AD_BYTES, nullptr, nonce, wrapping_key);
+
+    sodium_memzero(wrapping_key, sizeof(wrapping_key));
+
+    if (!write_file_atomically(work_dir + m_key_header_filename, header, sizeof(header))) {
+        error_logger("Failed to write the key header.");
+        return false;
+    }
+
+    return true;
+}
+
+void Crypt::set_io_backend(IoBackend backend) {
+    m_io_backend = backend;
 }
 
 void Crypt::error_logger(const char* msg) {
     std::cerr << msg << std::endl;
 }
 
-void Crypt::encrypt_file() {
-    std::string input_filename = work_dir + m_decrypted_filename;
-    std::string output_filename = work_dir + m_encrypted_filename;
 
-    std::ifstream input_file(input_filename, std::ios::binary);
-    if (!input_file.is_open()) {
+std::string Crypt::vault_path() {
+    return work_dir + m_vault_filename;
+}
+
+bool Crypt::legacy_vault_exists() {
+    return file_exists(work_dir + m_encrypted_filename) || file_exists(work_dir + m_decrypted_filename);
+}
+
+bool Crypt::retire_legacy_vault() {
+    std::string encrypted = work_dir + m_encrypted_filename;
+    std::string decrypted = work_dir + m_decrypted_filename;
+
+    // the old container stays around (still encrypted) in case the import needs redoing by hand.
+    if (file_exists(encrypted) && std::rename(encrypted.c_str(), (encrypted + ".migrated").c_str()) != 0) {
+        error_logger("Failed to retire the old vault.");
+        return false;
+    }
+
+    if (file_exists(decrypted) && std::remove(decrypted.c_str()) != 0) {
+        error_logger("Failed to remove the old plaintext vault.");
+        return false;
+    }
+
+    return true;
+}
+
+bool Crypt::decrypt_to_memory(std::vector<unsigned char>& plain) {
+    std::string input_filename = work_dir + m_encrypted_filename;
+    std::string leftover_filename = work_dir + m_decrypted_filename;
+
+    // a plaintext core.db is what an older version or an interrupted session leaves behind.
+    if (!file_exists(input_filename) && file_exists(leftover_filename)) {
+        std::cout << "no encrypted vault found, loading leftover plaintext vault: " << leftover_filename << std::endl;
+        return read_whole_file(leftover_filename, plain);
+    }
+
+    return decrypt_from_file(input_filename, plain);
+}
+
+bool Crypt::decrypt_from_file(const std::string& input_filename, std::vector<unsigned char>& plain) {
+    FileView encrypted;
+    if (!encrypted.open(input_filename, m_io_backend == IO_MMAP)) {
         error_logger("Failed to open input file for reading.");
-        return;
+        return false;
     }
 
-    std::ofstream output_file(output_filename, std::ios::binary);
-    if (!output_file.is_open()) {
-        error_logger("Failed to open output file for writing.");
-        return;
+    bool is_container = encrypted.size() >= sizeof(CONTAINER_MAGIC) &&
+        std::memcmp(encrypted.data(), CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+
+    bool decrypted = is_container ?
+        open_container(encrypted.data(), encrypted.size(), plain) :
+        open_legacy_stream(encrypted.data(), encrypted.size(), plain);
+
+    if (!decrypted) {
+        sodium_memzero(plain.data(), plain.size());
+        plain.clear();
     }
 
-    const int CHUNK_SIZE = 4096;
-    unsigned char buf_in[CHUNK_SIZE];
-    unsigned char buf_out[CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES];
-    unsigned long long out_len;
-    size_t read_bytes;
-    int eof;
-    unsigned char tag;
+    return decrypted;
+}
 
-    crypto_secretstream_xchacha20poly1305_init_push(&m_state, m_header, m_key);
+bool Crypt::encrypt_from_memory(const unsigned char* plain, size_t plain_size) {
+    if (!encrypt_to_file(plain, plain_size, work_dir + m_encrypted_filename)) {
+        return false;
+    }
 
-    output_file.write(reinterpret_cast<const char*>(m_header), sizeof(m_header));
+    // the vault is safely encrypted now, drop any plaintext copy left from an older version.
+    std::remove((work_dir + m_decrypted_filename).c_str());
 
-    do {
-    	input_file.read(reinterpret_cast<char*>(buf_in), sizeof(buf_in));
+    return true;
+}
 
-    	read_bytes = input_file.gcount();
-    	eof = input_file.eof();
-    	tag = eof ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : 0;
+bool Crypt::encrypt_to_file(const unsigned char* plain, size_t plain_size, const std::string& output_filename) {
+    bool written = write_file_atomically(output_filename, container_size(plain_size), m_io_backend == IO_MMAP,
+        [this, plain, plain_size](unsigned char* encrypted) {
+            seal_container(plain, plain_size, encrypted);
+        });
+
+    if (!written) {
+        error_logger("Failed to write encrypted vault.");
+        return false;
+    }
+
+    return true;
+}
 
-    	crypto_secretstream_xchacha20poly1305_push(&m_state, buf_out, &out_len, buf_in, read_bytes, nullptr, 0, tag);
+SecureString Crypt::random_string(size_t length) {
+    const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()-_=+";
+    const size_t max_index = sizeof(charset) - 1;
 
-    	output_file.write(reinterpret_cast<const char*>(buf_out), out_len);
-    } while (!input_file.eof());
+    SecureString password;
+    password.reserve(length);
 
-    input_file.close();
-    std::remove(input_filename.c_str()); // remove the decrypted file.
+    // Buffer to hold random bytes
+    std::vector<unsigned char> buffer(length);
+    randombytes_buf(buffer.data(), buffer.size());
 
-    output_file.close();
+    for (size_t i = 0; i < length; ++i) {
+        password += charset[buffer[i] % max_index];
+    }
+    sodium_memzero(buffer.data(), buffer.size());
+
+    return password;
+}
+
+void Crypt::encrypt_file() {
+    std::string input_filename = work_dir + m_decrypted_filename;
+    FileView plain;
+
+    if (!plain.open(input_filename, m_io_backend == IO_MMAP)) {
+        error_logger("Failed to open input file for reading.");
+        return;
+    }
+
+    if (encrypt_from_memory(plain.data(), plain.size())) {
+        std::remove(input_filename.c_str()); // remove the decrypted file.
+    }
 }
 
 void Crypt::decrypt_file() {
     std::string input_filename = work_dir + m_encrypted_filename;
     std::string output_filename = work_dir + m_decrypted_filename;
+    std::vector<unsigned char> plain;
 
-    std::ifstream input_file(input_filename, std::ios::binary);
-    if (!input_file.is_open()) {
+    if (!file_exists(input_filename)) {
         error_logger("Failed to open input file for reading.");
         return;
     }
 
-    std::ofstream output_file(output_filename, std::ios::binary);
-    if (!output_file.is_open()) {
-        error_logger("Failed to open output file for writing.");
+    if (!decrypt_to_memory(plain)) {
         return;
     }
 
-    const int CHUNK_SIZE = 4096;
-    unsigned char buf_in[CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES];
-    unsigned char buf_out[CHUNK_SIZE];
-    unsigned long long out_len;
-    size_t read_bytes;
-    unsigned char tag; 
+    bool written = write_file_atomically(output_filename, plain.size(), m_io_backend == IO_MMAP, [&plain](unsigned char* out) {
+        std::memcpy(out, plain.data(), plain.size());
+    });
+    sodium_memzero(plain.data(), plain.size());
 
-    input_file.read(reinterpret_cast<char*>(m_header), sizeof(m_header));
-    if (!input_file.good()) {
-        error_logger("Error reading header from input file.");
-        input_file.close();
-        output_file.close();
+    if (!written) {
+        error_logger("Failed to write the decrypted file.");
         return;
     }
 
-    if (crypto_secretstream_xchacha20poly1305_init_pull(&m_state, m_header, m_key) != 0) {
-        error_logger("Failed to initialize decryption.");
-        input_file.close();
-        output_file.close();
-        return;
-    }
+    std::remove(input_filename.c_str()); // remove the encrypted file only once the plaintext is safely written.
+}
 
-    do {
-        input_file.read(reinterpret_cast<char*>(buf_in), sizeof(buf_in));
-        read_bytes = input_file.gcount();
+void Crypt::seal_container(const unsigned char* plain, uint64_t plain_size, unsigned char* encrypted) {
+    uint64_t chunk_count = container_chunk_count(plain_size);
 
-        if (crypto_secretstream_xchacha20poly1305_pull(&m_state, buf_out, &out_len, &tag, buf_in, read_bytes, nullptr, 0) != 0) {
-            error_logger("Corrupted chunk or decryption error.");
-            input_file.close();
-            output_file.close();
-            return;
-        }
+    unsigned char* header = encrypted;
+    std::memcpy(header, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+    store_u32(header + 8, CONTAINER_VERSION);
+    store_u32(header + 12, CONTAINER_CHUNK_SIZE);
+    store_u64(header + 16, plain_size);
+    store_u64(header + 24, chunk_count);
+
+    unsigned char chunk_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+    derive_chunk_key(chunk_key);
+
+    parallel_for(chunk_count, [&](size_t i) {
+        unsigned char* record = encrypted + CONTAINER_HEADER_BYTES + i * CONTAINER_RECORD_BYTES;
+        unsigned char ad[CONTAINER_HEADER_BYTES + 8];
 
-        output_file.write(reinterpret_cast<const char*>(buf_out), out_len);
-    } while (!input_file.eof());
+        std::memcpy(ad, header, CONTAINER_HEADER_BYTES);
+        store_u64(ad + CONTAINER_HEADER_BYTES, i);
+        randombytes_buf(record, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
 
-    input_file.close();
-    std::remove(input_filename.c_str()); // remove the encrypted file.
+        crypto_aead_xchacha20poly1305_ietf_encrypt(
+            record + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, nullptr,
+            plain + i * CONTAINER_CHUNK_SIZE, container_chunk_length(i, plain_size),
+            ad, sizeof(ad), nullptr, record, chunk_key);
+    });
 
-    output_file.close();
+    sodium_memzero(chunk_key, sizeof(chunk_key));
 }
 
+bool Crypt::open_container(const unsigned char* encrypted, size_t encrypted_size, std::vector<unsigned char>& plain) {
+    if (encrypted_size < CONTAINER_HEADER_BYTES) {
+        error_logger("Error reading header from input file.");
+        return false;
+    }
 
-void Crypt::generate_and_store_key(const std::string& filename) {
-    unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    const unsigned char* header = encrypted;
+    uint32_t version     = load_u32(header + 8);
+    uint32_t chunk_size  = load_u32(header + 12);
+    uint64_t plain_size  = load_u64(header + 16);
+    uint64_t chunk_count = load_u64(header + 24);
 
-    crypto_secretstream_xchacha20poly1305_keygen(key);
+    if (version != CONTAINER_VERSION || chunk_size != CONTAINER_CHUNK_SIZE || chunk_count != container_chunk_count(plain_size)) {
+        error_logger("Unsupported or corrupted vault header.");
+        return false;
+    }
 
-    std::ofstream key_file(filename, std::ios::binary);
-    if (!key_file.is_open()) {
-        error_logger("Error opening key file.");
-        return;
+    if (encrypted_size != container_size(plain_size)) {
+        error_logger("Vault is truncated or has trailing data.");
+        return false;
     }
 
-    key_file.write(reinterpret_cast<const char*>(key), crypto_secretstream_xchacha20poly1305_KEYBYTES);
-}
+    unsigned char chunk_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+    derive_chunk_key(chunk_key);
 
-void Crypt::read_key(const std::string& filename, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES]) {
-    std::ifstream key_file(filename, std::ios::binary);
-    
-    if (!key_file.is_open()) {
-        error_logger("Error opening key file.");
-        return;
+    plain.resize(plain_size);
+    std::atomic<bool> failed(false);
+
+    parallel_for(chunk_count, [&](size_t i) {
+        const unsigned char* record = encrypted + CONTAINER_HEADER_BYTES + i * CONTAINER_RECORD_BYTES;
+        unsigned char ad[CONTAINER_HEADER_BYTES + 8];
+
+        std::memcpy(ad, header, CONTAINER_HEADER_BYTES);
+        store_u64(ad + CONTAINER_HEADER_BYTES, i);
+
+        if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+                plain.data() + i * CONTAINER_CHUNK_SIZE, nullptr, nullptr,
+                record + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES,
+                container_chunk_length(i, plain_size) + crypto_aead_xchacha20poly1305_ietf_ABYTES,
+                ad, sizeof(ad), record, chunk_key) != 0) {
+            failed = true;
+        }
+    });
+
+    sodium_memzero(chunk_key, sizeof(chunk_key));
+
+    if (failed) {
+        error_logger("Corrupted chunk or decryption error.");
+        return false;
     }
 
-    key_file.read(reinterpret_cast<char*>(key), crypto_secretstream_xchacha20poly1305_KEYBYTES);
+    return true;
 }
 
-void Crypt::generate_and_store_header(const std::string& filename) {
-    unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
-    randombytes_buf(header, crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+bool Crypt::open_legacy_stream(const unsigned char* encrypted, size_t encrypted_size, std::vector<unsigned char>& plain) {
+    const size_t CHUNK_SIZE = 4096;
+    const size_t RECORD_SIZE = CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES;
+    crypto_secretstream_xchacha20poly1305_state state;
+    unsigned long long out_len;
+    unsigned char tag;
 
-    std::ofstream header_file(filename, std::ios::binary);
-    
-    if (!header_file.is_open()) {
-        error_logger("Error opening header file.");
-        return;
+    // the stream header is the start of the file itself.
+    if (encrypted_size < crypto_secretstream_xchacha20poly1305_HEADERBYTES) {
+        error_logger("Error reading header from input file.");
+        return false;
+    }
+
+    if (crypto_secretstream_xchacha20poly1305_init_pull(&state, encrypted, m_key) != 0) {
+        error_logger("Failed to initialize decryption.");
+        return false;
     }
 
-    header_file.write(reinterpret_cast<const char*>(header), crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+    plain.clear();
+    plain.reserve(encrypted_size);
+
+    size_t offset = crypto_secretstream_xchacha20poly1305_HEADERBYTES;
+    do {
+        size_t record_len = std::min(RECORD_SIZE, encrypted_size - offset);
+        size_t plain_offset = plain.size();
+        plain.resize(plain_offset + CHUNK_SIZE);
+
+        if (crypto_secretstream_xchacha20poly1305_pull(&state, plain.data() + plain_offset, &out_len, &tag, encrypted + offset, record_len, nullptr, 0) != 0) {
+            error_logger("Corrupted chunk or decryption error.");
+            return false;
+        }
+
+        plain.resize(plain_offset + out_len);
+        offset += record_len;
+    } while (offset < encrypted_size);
+
+    return true;
+}
+
+void Crypt::derive_chunk_key(unsigned char chunk_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]) {
+    // the container never uses m_key directly, it gets its own subkey.
+    crypto_kdf_derive_from_key(chunk_key, crypto_aead_xchacha20poly1305_ietf_KEYBYTES, 1, "CSvault", m_key);
+}
+
+void Crypt::derive_page_key(unsigned char page_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]) {
+    crypto_kdf_derive_from_key(page_key, crypto_aead_xchacha20poly1305_ietf_KEYBYTES, 2, "CSpages", m_key);
 }
 
-void Crypt::read_header(const std::string& filename, unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES]) {
-    std::ifstream header_file(filename, std::ios::binary);
+bool Crypt::read_key(const std::string& filename, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES]) {
+    std::ifstream key_file(filename, std::ios::binary);
     
-    if (!header_file.is_open()) {
-        error_logger("Error opening header file.");
-        return;
+    if (!key_file.is_open()) {
+        error_logger("Error opening key file.");
+        return false;
+    }
+
+    key_file.read(reinterpret_cast<char*>(key), crypto_secretstream_xchacha20poly1305_KEYBYTES);
+
+    if (key_file.gcount() != crypto_secretstream_xchacha20poly1305_KEYBYTES) {
+        error_logger("Key file is truncated.");
+        return false;
     }
 
-    header_file.read(reinterpret_cast<char*>(header), crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+    return true;
 }
@@ -7,34 +7,144 @@
 #include <vector>
 #include <sstream>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <cerrno>
 #include <cstring>
 #include <stdio.h>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
 #include <sodium.h>
+#include "secure_memory.h"
 
 namespace CipherSafe {
 
   class Crypt  {
   public:
     Crypt();
-    ~Crypt() {};
+    ~Crypt();
     void encrypt_file();
     void decrypt_file();
+
+    /*
+     * in-memory variants: the decrypted vault only ever lives in memory.
+     * decrypt_to_memory() reads core.enc with one sequential read and
+     * encrypt_from_memory() writes core.enc straight from the given image.
+     */
+    bool decrypt_to_memory(std::vector<unsigned char>& plain);
+    bool encrypt_from_memory(const unsigned char* plain, size_t plain_size);
+
+    /*
+     * same as above for any path (backups). the file is written next to its
+     * final name first, fsynced and renamed over it once complete, so a crash
+     * leaves either the old file or the new one.
+     */
+    bool encrypt_to_file(const unsigned char* plain, size_t plain_size, const std::string& output_filename);
+    bool decrypt_from_file(const std::string& input_filename, std::vector<unsigned char>& plain);
+
+    /*
+     * how the files above are read and written. IO_MMAP (the default) maps
+     * them, so the chunk workers decrypt straight out of the page cache and
+     * encrypt straight into it. IO_BUFFERED copies through heap buffers with
+     * read()/write(), and is what mapped writes fall back to where the file's
+     * blocks can't be reserved up front. switchable mostly for the bench.
+     */
+    enum IoBackend {
+      IO_MMAP,
+      IO_BUFFERED
+    };
+    void set_io_backend(IoBackend backend);
+
+    /*
+     * the vault proper is core.vault, an on-disk database encrypted page by
+     * page (see EncryptedVFS) with a key derived here. core.enc / core.db are
+     * what older versions kept the whole vault in; they're imported once and
+     * then retired. until they are, the import counts as unfinished.
+     */
+    std::string vault_path();
+    void derive_page_key(unsigned char page_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]);
+    bool legacy_vault_exists();
+    bool retire_legacy_vault();
+
+    // random password made of letters, digits and symbols.
+    static SecureString random_string(size_t length);
     void init(const std::string& path);
 
+    /*
+     * the vault key is random and never stored as is. core.vault.key holds it
+     * encrypted under a key derived from the master password with Argon2id,
+     * along with the Argon2 cost it was derived with (authenticated as
+     * additional data, so it can't be lowered behind our back):
+     *
+     *   magic[8] | version u32 | alg u32 | opslimit u64 | memlimit u64 | salt[16] | nonce[24] | key + tag[48]
+     *
+     * installs from before the master password kept the raw key in
+     * .encryption_key.bin, create_master_password() wraps that key and
+     * deletes the file.
+     */
+    struct KdfParams {
+      unsigned long long opslimit;
+      size_t memlimit;
+    };
+
+    // libsodium's "interactive", "moderate" or "sensitive" presets, moderate for anything else.
+    static KdfParams kdf_profile(const std::string& name);
+    // seconds one derivation takes on this machine.
+    static double time_kdf(const KdfParams& params);
+    // the most expensive parameters that still derive in about target_seconds here, `seconds` gets what they should take.
+    static KdfParams calibrate_kdf(double target_seconds, double* seconds = nullptr);
+
+    bool has_master_password();
+    bool create_master_password(const SecureString& password, const KdfParams& params);
+    // false on a wrong password. a key stored with other parameters than `params` is re-wrapped with them.
+    bool unlock(const SecureString& password, const KdfParams& params);
+    bool unlocked();
+    // seconds the last unlock (or create) spent deriving keys.
+    double unlock_seconds();
 
   private:
     std::string work_dir;
     std::string m_encrypted_filename = "core.enc";
     std::string m_decrypted_filename = "core.db";
-    crypto_secretstream_xchacha20poly1305_state m_state;
+    std::string m_vault_filename = "core.vault";
+    std::string m_key_header_filename = "core.vault.key";
+    std::string m_legacy_key_filename = ".encryption_key.bin";
+    IoBackend m_io_backend = IO_MMAP;
+    bool m_unlocked = false;
+    double m_unlock_seconds = 0.0;
     unsigned char m_key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
-    unsigned char m_header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
 
-    void generate_and_store_key(const std::string& filename);
-    void read_key(const std::string& filename, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES]);
-    void generate_and_store_header(const std::string& filename);
-    void read_header(const std::string& filename, unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES]);
+    /*
+     * core.enc is written as a versioned container of independently
+     * authenticated chunks so they can be encrypted/decrypted in parallel:
+     *
+     *   header: magic[8] | version u32 | chunk_size u32 | plain_size u64 | chunk_count u64
+     *   chunk:  nonce[24] | ciphertext + tag
+     *
+     * each chunk binds the header and its own index as additional data, so
+     * chunks can't be reordered, dropped or moved between files. vaults still
+     * in the original single secretstream format are read by open_legacy_stream()
+     * and rewritten in the container format on the next save. every chunk
+     * gets a fresh random nonce on every save, nothing nonce-related lives
+     * outside the file.
+     */
+    // `encrypted` has room for the whole container.
+    void seal_container(const unsigned char* plain, uint64_t plain_size, unsigned char* encrypted);
+    bool open_container(const unsigned char* encrypted, size_t encrypted_size, std::vector<unsigned char>& plain);
+    bool open_legacy_stream(const unsigned char* encrypted, size_t encrypted_size, std::vector<unsigned char>& plain);
+    void derive_chunk_key(unsigned char chunk_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]);
+
+    bool write_key_header(const SecureString& password, const KdfParams& params);
+    bool derive_wrapping_key(const SecureString& password, const unsigned char* salt, const KdfParams& params, unsigned char wrapping_key[crypto_aead_xchacha20poly1305_ietf_KEYBYTES]);
+    // reads core.vault.key and unwraps the key in it into `key`, false on a wrong password or a bad header.
+    bool read_key_header(const SecureString& password, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES], KdfParams& stored);
+    // false unless the file holds a whole key.
+    bool read_key(const std::string& filename, unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES]);
     void error_logger(const char* msg);
   };
 }
@@ -0,0 +1,188 @@
+#include "csv_importer.h"
+
+using namespace CipherSafe;
+
+static const struct {
+    const char* name;
+    unsigned int field;
+} COLUMN_NAMES[] = {
+    { "title",          Database::FIELD_TITLE },
+    { "name",           Database::FIELD_TITLE },
+    { "url",            Database::FIELD_URL },
+    { "login_uri",      Database::FIELD_URL },
+    { "website",        Database::FIELD_URL },
+    { "uri",            Database::FIELD_URL },
+    { "username",       Database::FIELD_USERNAME },
+    { "login_username", Database::FIELD_USERNAME },
+    { "login",          Database::FIELD_USERNAME },
+    { "user",           Database::FIELD_USERNAME },
+    { "password",       Database::FIELD_PASSWORD },
+    { "login_password", Database::FIELD_PASSWORD },
+    { "category",       Database::FIELD_CATEGORY },
+    { "folder",         Database::FIELD_CATEGORY },
+    { "group",          Database::FIELD_CATEGORY },
+    { "grouping",       Database::FIELD_CATEGORY },
+    { "notes",          Database::FIELD_NOTES },
+    { "note",           Database::FIELD_NOTES },
+    { "extra",          Database::FIELD_NOTES },
+    { "comments",       Database::FIELD_NOTES },
+};
+
+static unsigned int column_field(std::string name) {
+    // header cells often come padded or capitalized.
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    for (const auto& column : COLUMN_NAMES) {
+        if (name == column.name) {
+            return column.field;
+        }
+    }
+
+    return 0;
+}
+
+CsvImporter::CsvImporter(std::istream& input): input(input) {}
+
+size_t CsvImporter::Line() const {
+    return this->line;
+}
+
+const std::string& CsvImporter::Error() const {
+    return this->error;
+}
+
+bool CsvImporter::Next(Database::Entry& entry) {
+    if (!this->header_read && !read_header()) {
+        return false;
+    }
+
+    std::vector<std::string> fields;
+
+    do {
+        if (!read_record(fields)) {
+            return false;
+        }
+    } while (fields.size() == 1 && fields[0].empty()); // blank line
+
+    entry = Database::Entry();
+
+    for (size_t i = 0; i < fields.size() && i < this->columns.size(); i++) {
+        switch (this->columns[i]) {
+            case Database::FIELD_TITLE:    entry.title    = std::move(fields[i]); break;
+            case Database::FIELD_URL:      entry.url      = std::move(fields[i]); break;
+            case Database::FIELD_USERNAME: entry.username = std::move(fields[i]); break;
+            case Database::FIELD_PASSWORD: entry.password = fields[i]; break;
+            case Database::FIELD_CATEGORY: entry.category = std::move(fields[i]); break;
+            case Database::FIELD_NOTES:    entry.notes    = fields[i]; break;
+        }
+    }
+
+    // the secrets now live in the entry, don't leave a plaintext copy on the heap.
+    for (auto& field : fields) {
+        sodium_memzero(&field[0], field.size());
+    }
+
+    return true;
+}
+
+Database::EntrySource CsvImporter::Source() {
+    return [this](Database::Entry& entry) {
+        if (Next(entry)) {
+            return true;
+        }
+
+        if (!this->error.empty()) {
+            throw std::runtime_error("line " + std::to_string(this->line) + ": " + this->error);
+        }
+
+        return false;
+    };
+}
+
+bool CsvImporter::read_header() {
+    std::vector<std::string> fields;
+
+    if (!read_record(fields)) {
+        if (this->error.empty()) {
+            this->error = "the file is empty";
+        }
+        return false;
+    }
+
+    // exports from windows tools like to start with a utf-8 byte order mark.
+    if (!fields.empty() && fields[0].compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        fields[0].erase(0, 3);
+    }
+
+    bool any_known = false;
+    for (const auto& name : fields) {
+        this->columns.push_back(column_field(name));
+        any_known = any_known || this->columns.back() != 0;
+    }
+
+    if (!any_known) {
+        this->error = "the header row has no title, url, username, password, category or notes column";
+        return false;
+    }
+
+    this->header_read = true;
+    return true;
+}
+
+bool CsvImporter::read_record(std::vector<std::string>& fields) {
+    std::streambuf* buffer = this->input.rdbuf();
+    fields.clear();
+
+    if (buffer == nullptr || buffer->sgetc() == std::char_traits<char>::eof()) {
+        return false;
+    }
+
+    this->line++;
+    size_t record_line = this->line;
+    std::string field;
+    bool quoted = false;
+
+    while (true) {
+        int c = buffer->sbumpc();
+
+        if (quoted) {
+            if (c == std::char_traits<char>::eof()) {
+                this->error = "quoted field starting on line " + std::to_string(record_line) + " never ends";
+                return false;
+            }
+
+            if (c == '"') {
+                // "" inside a quoted field is a literal quote.
+                if (buffer->sgetc() == '"') {
+                    buffer->sbumpc();
+                    field += '"';
+                } else {
+                    quoted = false;
+                }
+            } else {
+                if (c == '\n') {
+                    this->line++;
+                }
+                field += static_cast<char>(c);
+            }
+            continue;
+        }
+
+        if (c == '"' && field.empty()) {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(std::move(field));
+            field.clear();
+        } else if (c == '\r' || c == '\n' || c == std::char_traits<char>::eof()) {
+            if (c == '\r' && buffer->sgetc() == '\n') {
+                buffer->sbumpc();
+            }
+            fields.push_back(std::move(field));
+            return true;
+        } else {
+            field += static_cast<char>(c);
+        }
+    }
+}
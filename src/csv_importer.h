@@ -0,0 +1,54 @@
+#ifndef CSV_IMPORTER_H
+#define CSV_IMPORTER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "database.h"
+
+namespace CipherSafe {
+
+  /*
+   * streams entries out of a CSV export: one header row, then one entry per
+   * record (RFC 4180 quoting, so fields can hold commas, quotes and newlines).
+   * columns are matched by header name, which covers the exports of most
+   * password managers:
+   *
+   *   title:    title, name
+   *   url:      url, login_uri, website, uri
+   *   username: username, login_username, login, user
+   *   password: password, login_password
+   *   category: category, folder, group, grouping
+   *   notes:    notes, note, extra, comments
+   *
+   * anything else is ignored.
+   */
+  class CsvImporter {
+  public:
+    explicit CsvImporter(std::istream& input);
+
+    // false at the end of the input or on malformed input (see Error()).
+    bool Next(Database::Entry& entry);
+
+    /*
+     * Next() as a Database::AddBatch() source. malformed input throws, so the
+     * batch gets rolled back instead of committing half a file.
+     */
+    Database::EntrySource Source();
+
+    size_t Line() const;
+    const std::string& Error() const;
+
+  private:
+    std::istream& input;
+    std::vector<unsigned int> columns; // Database::Field per column, 0 = ignored
+    bool header_read = false;
+    size_t line = 0;
+    std::string error;
+
+    bool read_header();
+    bool read_record(std::vector<std::string>& fields);
+  };
+}
+#endif
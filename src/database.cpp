@@ -2,21 +2,192 @@
 
 using namespace CipherSafe;
 
-Database::Database(const std::string& path): path(path) {
+/*
+ * every fixed query the Database runs, one per Database::Query. They are
+ * prepared once by prepare_statements() and reused (reset + cleared) for the
+ * lifetime of the connection.
+ */
+static const char* INSERT_SQL       = "INSERT INTO secrets (title, url, username, password, category, notes) VALUES (?, ?, ?, ?, ?, ?);";
+static const char* UPDATE_SQL       = "UPDATE secrets SET title = ?, url = ?, username = ?, password = ?, category = ?, notes = ? WHERE id = ?;";
+static const char* SELECT_ALL_SQL   = "SELECT id, title, url, username, password, category, notes FROM secrets ORDER BY id;";
+static const char* FILTER_SQL       = "SELECT id, title, url, username, password, category, notes FROM secrets WHERE url LIKE ? OR title LIKE ? OR category LIKE ?";
+static const char* SELECT_BY_ID_SQL = "SELECT id, title, username, password, url, category, notes FROM secrets WHERE id = ?";
+static const char* DELETE_BY_ID_SQL = "DELETE FROM secrets WHERE id = ?";
+static const char* SEARCH_SQL       = "SELECT rowid FROM secrets_fts WHERE secrets_fts MATCH ? LIMIT ?;";
+static const char* RANKED_SEARCH_SQL = "SELECT rowid FROM secrets_fts WHERE secrets_fts MATCH ? ORDER BY bm25(secrets_fts, 10.0, 5.0, 2.0) LIMIT ?;";
+
+// how many rows AddBatch() inserts between progress callbacks.
+static const size_t BATCH_PROGRESS_INTERVAL = 4096;
+
+/*
+ * bm25 has to score every hit before it can sort, which is what makes short,
+ * broad prefixes slow on big vaults. Result sets larger than this come back
+ * in id order instead of ranked.
+ */
+static const int MAX_RANKED_RESULTS = 512;
+
+/*
+ * secrets_fts is an external content FTS5 index over the searchable columns
+ * of secrets. The triggers keep it in sync so no C++ code has to.
+ */
+static const char* CREATE_FTS_SQL =
+    "CREATE VIRTUAL TABLE IF NOT EXISTS secrets_fts USING fts5("
+    "  title, url, category,"
+    "  content='secrets', content_rowid='id',"
+    "  tokenize='unicode61 remove_diacritics 2', prefix='2 3'"
+    ");"
+    "CREATE TRIGGER IF NOT EXISTS secrets_fts_ad AFTER DELETE ON secrets BEGIN"
+    "  INSERT INTO secrets_fts(secrets_fts, rowid, title, url, category) VALUES ('delete', old.id, old.title, old.url, old.category);"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS secrets_fts_au AFTER UPDATE OF title, url, category ON secrets BEGIN"
+    "  INSERT INTO secrets_fts(secrets_fts, rowid, title, url, category) VALUES ('delete', old.id, old.title, old.url, old.category);"
+    "  INSERT INTO secrets_fts(rowid, title, url, category) VALUES (new.id, new.title, new.url, new.category);"
+    "END;";
+
+static const char* CREATE_FTS_INSERT_TRIGGER_SQL =
+    "CREATE TRIGGER IF NOT EXISTS secrets_fts_ai AFTER INSERT ON secrets BEGIN"
+    "  INSERT INTO secrets_fts(rowid, title, url, category) VALUES (new.id, new.title, new.url, new.category);"
+    "END;";
+
+/*
+ * firing the insert trigger once per row makes FTS5 do its bookkeeping once
+ * per row too, which is most of the cost of a big import. AddBatch() drops
+ * the trigger for the length of its transaction and indexes the whole batch
+ * with this one statement instead.
+ */
+static const char* INDEX_BATCH_SQL = "INSERT INTO secrets_fts(rowid, title, url, category) SELECT id, title, url, category FROM secrets WHERE id >= ?;";
+
+/*
+ * schema changes since the first release, applied in order by migrate().
+ * PRAGMA user_version holds the version of the last one a vault has seen,
+ * so each runs exactly once per vault. a released migration never changes,
+ * new ones go at the end with the next version.
+ */
+struct Migration {
+    int version;
+    const char* description;
+    const char* sql;
+};
+
+static const Migration MIGRATIONS[] = {
+    { 1, "index secrets by category", "CREATE INDEX IF NOT EXISTS secrets_category ON secrets(category);" },
+    { 2, "index secrets by url",      "CREATE INDEX IF NOT EXISTS secrets_url ON secrets(url);" },
+};
+static const int SCHEMA_VERSION = MIGRATIONS[sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]) - 1].version;
+
+/*
+ * resets a cached statement and clears its bindings once it goes out of
+ * scope, so the next caller always gets it back in a clean state.
+ */
+struct StatementGuard {
+    sqlite3_stmt* stmt;
+
+    explicit StatementGuard(sqlite3_stmt* stmt): stmt(stmt) {}
+    ~StatementGuard() {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+};
+
+/*
+ * turns free text typed into the search box into an FTS5 MATCH expression:
+ * every term becomes a quoted prefix term and all terms must match.
+ * e.g: `git hub` -> `"git"* "hub"*`
+ */
+static std::string fts_match_expression(const std::string& query) {
+    std::string expression;
+
+    for (const auto& term : Database::SearchTerms(query)) {
+        if (!expression.empty()) {
+            expression += " ";
+        }
+
+        expression += "\"" + term + "\"*";
+    }
+
+    return expression;
+}
+
+/*
+ * closes a half-opened Database when its constructor throws: no destructor
+ * runs then, so without this the connection (and an encrypted vault's key
+ * in EncryptedVFS) would outlive it. dismissed once the open succeeds.
+ */
+struct OpenGuard {
+    std::function<void()> undo;
+    bool active = true;
+
+    explicit OpenGuard(std::function<void()> undo): undo(undo) {}
+    ~OpenGuard() {
+        if (active) {
+            undo();
+        }
+    }
+    void dismiss() { active = false; }
+};
+
+static const char* column_text(sqlite3_stmt* stmt, int col) {
+    const unsigned char* text = sqlite3_column_text(stmt, col);
+    return text ? reinterpret_cast<const char*>(text) : "";
+}
+
+static std::string column_string(sqlite3_stmt* stmt, int col) {
+    return column_text(stmt, col);
+}
+
+Database::Database(const std::string& path, const StorageParams& storage): path(path) {
+  OpenGuard guard([this]() { Close(); });
+
   init_db();
-  create_tables();
+  configure_storage(storage);
+  migrate();
+  prepare_statements();
+  load_entries();
+
+  guard.dismiss();
 }
 
-bool Database::Add(std::unique_ptr<Database::Entry> entry) {
-    const char* insert_sql = "INSERT INTO secrets (title, url, username, password, category, notes) VALUES (?, ?, ?, ?, ?, ?);";
-    sqlite3_stmt* stmt;
+Database::Database(const std::vector<unsigned char>& image): path(":memory:") {
+  OpenGuard guard([this]() { Close(); });
 
-    int rc = sqlite3_prepare_v2(this->db, insert_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+  init_db();
+  deserialize(image);
+  migrate();
+  prepare_statements();
+  load_entries();
+
+  guard.dismiss();
+}
+
+Database::Database(const std::string& path, const unsigned char page_key[EncryptedVFS::KEY_BYTES], const StorageParams& storage):
+  path(path), vfs(EncryptedVFS::NAME) {
+  if (!EncryptedVFS::Register()) {
+    throw std::runtime_error("An error occured while attempting to open the database: encrypted vfs unavailable");
+  }
+
+  EncryptedVFS::SetKey(path, page_key);
+  // also drops the key again, Close() does that for encrypted vaults.
+  OpenGuard guard([this]() { Close(); });
+
+  init_db();
+  configure_encryption();
+  configure_storage(storage);
+  migrate();
+  prepare_statements();
+  load_entries();
+
+  guard.dismiss();
+}
+
+bool Database::Add(std::unique_ptr<Database::Entry> entry) {
+    sqlite3_stmt* stmt = statement(QUERY_INSERT);
+    if (stmt == nullptr) {
         std::cout << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
         return false;
     }
 
+    StatementGuard guard(stmt);
+
     sqlite3_bind_text(stmt, 1, entry->title.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, entry->url.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, entry->username.c_str(), -1, SQLITE_STATIC);
@@ -24,28 +195,156 @@ bool Database::Add(std::unique_ptr<Database::Entry> entry) {
     sqlite3_bind_text(stmt, 5, entry->category.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 6, entry->notes.c_str(), -1, SQLITE_STATIC);
 
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         std::cout << "Execution failed: " << sqlite3_errmsg(this->db) << std::endl;
-        sqlite3_finalize(stmt);
         return false;
     }
 
-    sqlite3_finalize(stmt);
+    entry->id = static_cast<int>(sqlite3_last_insert_rowid(this->db));
+    this->categories.Add(entry->id, entry->category);
+    auto pos = std::lower_bound(this->entries.begin(), this->entries.end(), entry->id,
+        [](const Database::Entry& e, int id) { return e.id < id; });
+    this->entries.insert(pos, std::move(*entry));
+    this->generation++;
+
     return true;
 }
 
 
-bool Database::Update(Database::Entry* entry) {
-    const char* update_sql = "UPDATE secrets SET title = ?, url = ?, username = ?, password = ?, category = ?, notes = ? WHERE id = ?;";
-    sqlite3_stmt* stmt;
+bool Database::AddBatch(const EntrySource& next, const BatchProgress& progress) {
+    sqlite3_stmt* stmt = statement(QUERY_INSERT);
+    if (stmt == nullptr) {
+        std::cout << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
 
-    int rc = sqlite3_prepare_v2(this->db, update_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    if (sqlite3_exec(this->db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cout << "Failed to start batch: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    // a rollback brings the trigger back along with everything else.
+    if (sqlite3_exec(this->db, "DROP TRIGGER IF EXISTS secrets_fts_ai;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cout << "Failed to start batch: " << sqlite3_errmsg(this->db) << std::endl;
+        sqlite3_exec(this->db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+
+    // rows only join the cache once the whole batch is committed.
+    std::vector<Database::Entry> added;
+    Database::Entry entry = Database::Entry();
+    bool ok = true;
+
+    try {
+        while (ok && next(entry)) {
+            StatementGuard guard(stmt);
+
+            sqlite3_bind_text(stmt, 1, entry.title.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, entry.url.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, entry.username.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, entry.password.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 5, entry.category.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 6, entry.notes.c_str(), -1, SQLITE_STATIC);
+
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cout << "Execution failed: " << sqlite3_errmsg(this->db) << std::endl;
+                ok = false;
+                break;
+            }
+
+            entry.id = static_cast<int>(sqlite3_last_insert_rowid(this->db));
+            added.push_back(std::move(entry));
+            entry = Database::Entry();
+
+            if (progress && added.size() % BATCH_PROGRESS_INTERVAL == 0 && !progress(added.size())) {
+                ok = false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Batch aborted: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    if (ok && !added.empty()) {
+        ok = index_batch(added.front().id);
+    }
+
+    if (ok && sqlite3_exec(this->db, CREATE_FTS_INSERT_TRIGGER_SQL, nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cout << "Failed to restore search trigger: " << sqlite3_errmsg(this->db) << std::endl;
+        ok = false;
+    }
+
+    if (ok && sqlite3_exec(this->db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cout << "Failed to commit batch: " << sqlite3_errmsg(this->db) << std::endl;
+        ok = false;
+    }
+
+    if (!ok) {
+        sqlite3_exec(this->db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+
+    if (progress) {
+        progress(added.size());
+    }
+
+    // AUTOINCREMENT ids only grow, so the batch normally just goes on the end.
+    bool in_order = this->entries.empty() || added.empty() || added.front().id > this->entries.back().id;
+    for (const auto& entry : added) {
+        this->categories.Add(entry.id, entry.category);
+    }
+    this->entries.insert(this->entries.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+
+    if (!in_order) {
+        std::sort(this->entries.begin(), this->entries.end(),
+            [](const Database::Entry& a, const Database::Entry& b) { return a.id < b.id; });
+    }
+
+    this->generation++;
+    return true;
+}
+
+bool Database::index_batch(int first_id) {
+    sqlite3_stmt* stmt = statement(QUERY_INDEX_BATCH);
+    if (stmt == nullptr) {
         std::cout << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
         return false;
     }
 
+    StatementGuard guard(stmt);
+    sqlite3_bind_int(stmt, 1, first_id);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cout << "Failed to index batch: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::AddBatch(const std::vector<Database::Entry>& batch, const BatchProgress& progress) {
+    size_t i = 0;
+
+    return AddBatch([&batch, &i](Database::Entry& entry) {
+        if (i == batch.size()) {
+            return false;
+        }
+
+        entry = batch[i++];
+        return true;
+    }, progress);
+}
+
+bool Database::Update(Database::Entry* entry) {
+    sqlite3_stmt* stmt = statement(QUERY_UPDATE);
+    if (stmt == nullptr) {
+        std::cout << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    StatementGuard guard(stmt);
+
     sqlite3_bind_text(stmt, 1, entry->title.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, entry->url.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, entry->username.c_str(), -1, SQLITE_STATIC);
@@ -54,29 +353,332 @@ bool Database::Update(Database::Entry* entry) {
     sqlite3_bind_text(stmt, 6, entry->notes.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 7, entry->id);
 
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         std::cout << "Execution failed: " << sqlite3_errmsg(this->db) << std::endl;
-        sqlite3_finalize(stmt);
         return false;
     }
 
-    sqlite3_finalize(stmt);
+    auto cached = find_cached(entry->id);
+    if (cached != this->entries.end()) {
+        this->categories.Move(entry->id, cached->category, entry->category);
+        *cached = *entry;
+        this->generation++;
+    }
+
+    return true;
+}
+
+bool Database::UpdateFields(const Database::Entry& entry, unsigned int fields) {
+    const struct {
+        unsigned int field;
+        const char* column;
+        const char* value;
+    } columns[] = {
+        { FIELD_TITLE,    "title",    entry.title.c_str() },
+        { FIELD_URL,      "url",      entry.url.c_str() },
+        { FIELD_USERNAME, "username", entry.username.c_str() },
+        { FIELD_PASSWORD, "password", entry.password.c_str() },
+        { FIELD_CATEGORY, "category", entry.category.c_str() },
+        { FIELD_NOTES,    "notes",    entry.notes.c_str() },
+    };
+
+    fields &= UPDATE_COMBINATIONS - 1;
+    if (fields == 0) {
+        return true;
+    }
+
+    // every combination of columns gets its own statement, prepared on first use and then cached.
+    sqlite3_stmt*& stmt = this->update_statements[fields];
+    const char* values[sizeof(columns) / sizeof(columns[0])];
+    int count = 0;
+
+    for (const auto& column : columns) {
+        if (fields & column.field) {
+            values[count++] = column.value;
+        }
+    }
+
+    if (stmt == nullptr) {
+        std::string sql = "UPDATE secrets SET ";
+
+        for (const auto& column : columns) {
+            if (fields & column.field) {
+                sql += sql.back() == '?' ? ", " : "";
+                sql += std::string(column.column) + " = ?";
+            }
+        }
+
+        sql += " WHERE id = ?;";
+        stmt = prepare(sql.c_str());
+    }
+
+    if (stmt == nullptr) {
+        std::cout << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    StatementGuard guard(stmt);
+
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, i + 1, values[i], -1, SQLITE_STATIC);
+    }
+    sqlite3_bind_int(stmt, count + 1, entry.id);
+
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cout << "Execution failed: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    auto cached = find_cached(entry.id);
+    if (cached != this->entries.end()) {
+        if (fields & FIELD_TITLE)    cached->title    = entry.title;
+        if (fields & FIELD_URL)      cached->url      = entry.url;
+        if (fields & FIELD_USERNAME) cached->username = entry.username;
+        if (fields & FIELD_PASSWORD) cached->password = entry.password;
+        if (fields & FIELD_CATEGORY) {
+            this->categories.Move(entry.id, cached->category, entry.category);
+            cached->category = entry.category;
+        }
+        if (fields & FIELD_NOTES)    cached->notes    = entry.notes;
+        this->generation++;
+    }
+
     return true;
 }
 
 void Database::init_db() {
   sqlite3* database;
   int exit_status;
-  exit_status = sqlite3_open(this->path.c_str(), &database);
+  exit_status = sqlite3_open_v2(this->path.c_str(), &database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, this->vfs);
 
   if (exit_status) {
-    throw std::runtime_error("An error occured while attempting to open the database:" + std::string(sqlite3_errmsg(database)));
+    std::string error = sqlite3_errmsg(database);
+    sqlite3_close(database); // sqlite hands out a handle even when the open fails
+    throw std::runtime_error("An error occured while attempting to open the database:" + error);
   } else {
     this->db = database;
+    // a Backup reads the vault through its own connection; wait it out instead of failing with SQLITE_BUSY.
+    sqlite3_busy_timeout(this->db, 2000);
   }
 }
 
+void Database::deserialize(const std::vector<unsigned char>& image, const char* schema) {
+    if (image.empty()) {
+        return;
+    }
+
+    // sqlite takes ownership of the buffer and can grow it as the vault grows.
+    unsigned char* buffer = static_cast<unsigned char*>(sqlite3_malloc64(image.size()));
+    if (buffer == nullptr) {
+        throw std::runtime_error("Out of memory loading the database image.");
+    }
+
+    std::memcpy(buffer, image.data(), image.size());
+
+    /*
+     * a snapshot of a WAL vault still says WAL in its header (the read and
+     * write version bytes), which an in-memory database can't open. it is
+     * a complete image either way, so it opens as a rollback journal one.
+     */
+    if (image.size() >= 100 && buffer[18] == 2 && buffer[19] == 2) {
+        buffer[18] = 1;
+        buffer[19] = 1;
+    }
+
+    int rc = sqlite3_deserialize(this->db, schema, buffer, image.size(), image.size(),
+                                 SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+
+    if (rc != SQLITE_OK) {
+        throw std::runtime_error("An error occured while attempting to load the database image:" + std::string(sqlite3_errmsg(this->db)));
+    }
+}
+
+/*
+ * the page layout has to be settled before sqlite writes page 1 of a new
+ * vault: fixed size pages with room reserved at the end of each one for the
+ * vfs's nonce and tag. existing vaults keep what their header says.
+ */
+void Database::configure_encryption() {
+    std::string pragmas = "PRAGMA page_size = " + std::to_string(EncryptedVFS::PAGE_SIZE) + ";"
+                          "PRAGMA temp_store = MEMORY;";
+    char* db_error_msg = nullptr;
+
+    int rc = sqlite3_exec(this->db, pragmas.c_str(), 0, 0, &db_error_msg);
+    sqlite3_free(db_error_msg);
+
+    int reserve = EncryptedVFS::RESERVE_BYTES;
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_file_control(this->db, "main", SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+    }
+
+    // reading the schema is the first thing that has to decrypt a page.
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(this->db, "SELECT count(*) FROM sqlite_master;", 0, 0, &db_error_msg);
+        sqlite3_free(db_error_msg);
+    }
+
+    if (rc != SQLITE_OK) {
+        throw std::runtime_error("Unable to open the vault (wrong key or corrupted file): " + std::string(sqlite3_errmsg(this->db)));
+    }
+}
+
+Database::StorageParams::StorageParams() {}
+
+Database::StorageParams Database::StorageProfile(const std::string& name) {
+    StorageParams storage;
+
+    if (name == "balanced") {
+        storage.synchronous = "NORMAL";
+        storage.cache_size = -16384;
+        storage.mmap_size = 64LL * 1024 * 1024;
+    } else if (name == "fast") {
+        storage.synchronous = "OFF";
+        storage.cache_size = -65536;
+        storage.mmap_size = 256LL * 1024 * 1024;
+    }
+
+    return storage;
+}
+
+// pragma values end up in the sql text, so only plain keywords get through.
+static bool is_keyword(const std::string& value) {
+    return !value.empty() && std::all_of(value.begin(), value.end(), [](char c) { return std::isalpha(static_cast<unsigned char>(c)); });
+}
+
+/*
+ * page_size has to come before anything writes page 1, journal_mode before
+ * the first transaction. a pragma sqlite turns down is reported and the
+ * connection carries on with what it has.
+ */
+void Database::configure_storage(const StorageParams& storage) {
+    std::vector<std::string> pragmas;
+    bool encrypted = this->vfs != nullptr;
+
+    if (!encrypted) {
+        if (storage.page_size > 0) {
+            pragmas.push_back("page_size = " + std::to_string(storage.page_size));
+        }
+        if (is_keyword(storage.temp_store)) {
+            pragmas.push_back("temp_store = " + storage.temp_store);
+        }
+        pragmas.push_back("mmap_size = " + std::to_string(storage.mmap_size));
+    }
+
+    if (storage.cache_size != 0) {
+        pragmas.push_back("cache_size = " + std::to_string(storage.cache_size));
+    }
+    if (is_keyword(storage.synchronous)) {
+        pragmas.push_back("synchronous = " + storage.synchronous);
+    }
+
+    for (const auto& pragma : pragmas) {
+        char* db_error_msg = nullptr;
+
+        if (sqlite3_exec(this->db, ("PRAGMA " + pragma + ";").c_str(), 0, 0, &db_error_msg) != SQLITE_OK) {
+            std::cerr << "Couldn't set PRAGMA " << pragma << ": " << sqlite3_errmsg(this->db) << std::endl;
+        }
+        sqlite3_free(db_error_msg);
+    }
+
+    if (!is_keyword(storage.journal_mode)) {
+        return;
+    }
+
+    // journal_mode answers with the mode it ended up in rather than failing.
+    std::string wanted = storage.journal_mode;
+    std::transform(wanted.begin(), wanted.end(), wanted.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+
+    std::string mode = Pragma("journal_mode = " + wanted);
+    if (mode != wanted) {
+        std::cerr << "journal_mode stays " << mode << ", " << wanted << " isn't available here." << std::endl;
+    }
+}
+
+std::string Database::Pragma(const std::string& name) {
+    sqlite3_stmt* stmt = nullptr;
+    std::string value;
+
+    if (sqlite3_prepare_v2(this->db, ("PRAGMA " + name + ";").c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(this->db) << std::endl;
+        return value;
+    }
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = column_string(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return value;
+}
+
+bool Database::Import(const std::vector<unsigned char>& image) {
+    if (image.empty()) {
+        return true;
+    }
+
+    char* db_error_msg = nullptr;
+    int rc = sqlite3_exec(this->db, "ATTACH DATABASE ':memory:' AS import;", 0, 0, &db_error_msg);
+    sqlite3_free(db_error_msg);
+
+    if (rc != SQLITE_OK) {
+        std::cerr << "Error importing vault: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    try {
+        deserialize(image, "import");
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        sqlite3_exec(this->db, "DETACH DATABASE import;", 0, 0, nullptr);
+        return false;
+    }
+
+    // ids are kept as they are, the search index triggers fill secrets_fts along the way.
+    rc = sqlite3_exec(this->db,
+        "BEGIN;"
+        "INSERT INTO main.secrets (id, title, url, username, password, category, notes)"
+        "  SELECT id, title, url, username, password, category, notes FROM import.secrets;"
+        "COMMIT;", 0, 0, &db_error_msg);
+    sqlite3_free(db_error_msg);
+
+    if (rc != SQLITE_OK) {
+        std::cerr << "Error importing vault: " << sqlite3_errmsg(this->db) << std::endl;
+        sqlite3_exec(this->db, "ROLLBACK;", 0, 0, nullptr);
+    }
+
+    sqlite3_exec(this->db, "DETACH DATABASE import;", 0, 0, nullptr);
+
+    if (rc != SQLITE_OK) {
+        return false;
+    }
+
+    load_entries();
+    return true;
+}
+
+bool Database::Serialize(const std::function<bool(const unsigned char*, size_t)>& sink) {
+    sqlite3_int64 size = 0;
+
+    // in-memory databases can be handed over as is, anything else needs a copy.
+    unsigned char* image = sqlite3_serialize(this->db, "main", &size, SQLITE_SERIALIZE_NOCOPY);
+    if (image != nullptr) {
+        return sink(image, static_cast<size_t>(size));
+    }
+
+    image = sqlite3_serialize(this->db, "main", &size, 0);
+    if (image == nullptr) {
+        std::cerr << "Error serializing database: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    bool result = sink(image, static_cast<size_t>(size));
+    sqlite3_free(image);
+
+    return result;
+}
+
 int Database::create_tables() {
     char* db_error_msg = nullptr;
     std::string create_sql = "CREATE TABLE IF NOT EXISTS secrets (id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT, url TEXT, username TEXT, password TEXT, category TEXT, notes TEXT);";
@@ -86,16 +688,163 @@ int Database::create_tables() {
     if (exit_status != SQLITE_OK) {
         std::cout << "Error creating table: " << sqlite3_errmsg(this->db) << std::endl;
         sqlite3_free(db_error_msg);
+        return exit_status;
+    }
+
+    // vaults created before the search index existed need it built once from the current rows.
+    bool fts_existed = table_exists("secrets_fts");
+
+    std::string fts_sql = std::string(CREATE_FTS_SQL) + CREATE_FTS_INSERT_TRIGGER_SQL;
+    exit_status = sqlite3_exec(this->db, fts_sql.c_str(), 0, 0, &db_error_msg);
+
+    if (exit_status != SQLITE_OK) {
+        std::cout << "Error creating search index: " << sqlite3_errmsg(this->db) << std::endl;
+        sqlite3_free(db_error_msg);
+        return exit_status;
+    }
+
+    if (!fts_existed) {
+        exit_status = sqlite3_exec(this->db, "INSERT INTO secrets_fts(secrets_fts) VALUES ('rebuild');", 0, 0, &db_error_msg);
+
+        if (exit_status != SQLITE_OK) {
+            std::cout << "Error building search index: " << sqlite3_errmsg(this->db) << std::endl;
+            sqlite3_free(db_error_msg);
+        }
     }
 
     return exit_status;
 }
 
+/*
+ * creates the tables of a new vault and brings any vault up to
+ * SCHEMA_VERSION, all in one transaction that commits together with the new
+ * user_version, so a crash or a failure leaves the vault as it was and the
+ * next open starts over. a vault from a newer CipherSafe is refused before
+ * anything in it is touched.
+ */
+void Database::migrate() {
+    std::string error;
+    int version = 0;
+
+    // holding the write lock from the start, nobody can change the schema between the version check and the DDL.
+    if (sqlite3_exec(this->db, "BEGIN IMMEDIATE;", 0, 0, nullptr) != SQLITE_OK) {
+        error = std::string("couldn't lock the vault: ") + sqlite3_errmsg(this->db);
+    } else {
+        version = SchemaVersion();
+    }
+
+    if (error.empty() && version > SCHEMA_VERSION) {
+        error = "the vault was written by a newer CipherSafe (schema " + std::to_string(version) + ")";
+    }
+
+    if (error.empty() && create_tables() != SQLITE_OK) {
+        error = std::string("creating the tables failed: ") + sqlite3_errmsg(this->db);
+    }
+
+    for (const auto& migration : MIGRATIONS) {
+        if (!error.empty()) {
+            break;
+        }
+        if (migration.version <= version) {
+            continue;
+        }
+
+        if (sqlite3_exec(this->db, migration.sql, 0, 0, nullptr) != SQLITE_OK) {
+            error = "migration " + std::to_string(migration.version) + " (" + migration.description + ") failed: " + sqlite3_errmsg(this->db);
+        }
+    }
+
+    if (error.empty() && version != SCHEMA_VERSION) {
+        std::string sql = "PRAGMA user_version = " + std::to_string(SCHEMA_VERSION) + ";";
+
+        if (sqlite3_exec(this->db, sql.c_str(), 0, 0, nullptr) != SQLITE_OK) {
+            error = std::string("updating the schema version failed: ") + sqlite3_errmsg(this->db);
+        }
+    }
+
+    if (error.empty() && sqlite3_exec(this->db, "COMMIT;", 0, 0, nullptr) != SQLITE_OK) {
+        error = std::string("committing the schema failed: ") + sqlite3_errmsg(this->db);
+    }
+
+    if (!error.empty()) {
+        sqlite3_exec(this->db, "ROLLBACK;", 0, 0, nullptr);
+        throw std::runtime_error("Unable to open the database: " + error);
+    }
+}
+
+int Database::SchemaVersion() {
+    return std::atoi(Pragma("user_version").c_str());
+}
+
+int Database::LatestSchemaVersion() {
+    return SCHEMA_VERSION;
+}
+
+bool Database::table_exists(const std::string& name) {
+    sqlite3_stmt* stmt = nullptr;
+    bool exists = false;
+
+    if (sqlite3_prepare_v2(this->db, "SELECT 1 FROM sqlite_master WHERE name = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return exists;
+    }
+
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+
+    return exists;
+}
+
+void Database::prepare_statements() {
+    for (int query = 0; query < QUERY_COUNT; query++) {
+        if (statement(static_cast<Query>(query)) == nullptr) {
+            std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(this->db) << std::endl;
+        }
+    }
+}
+
+sqlite3_stmt* Database::statement(Query query) {
+    // in Query's order.
+    static const char* const queries[QUERY_COUNT] = {
+        INSERT_SQL, UPDATE_SQL, SELECT_ALL_SQL, FILTER_SQL, SELECT_BY_ID_SQL, DELETE_BY_ID_SQL, SEARCH_SQL, RANKED_SEARCH_SQL, INDEX_BATCH_SQL
+    };
+
+    // one that failed to prepare is tried again on the next use.
+    if (this->statements[query] == nullptr) {
+        this->statements[query] = prepare(queries[query]);
+    }
+
+    return this->statements[query];
+}
+
+sqlite3_stmt* Database::prepare(const char* sql) {
+    sqlite3_stmt* stmt = nullptr;
+    int rc = sqlite3_prepare_v3(this->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return nullptr;
+    }
+
+    return stmt;
+}
+
+void Database::finalize_statements() {
+    for (auto& stmt : this->statements) {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+
+    for (auto& stmt : this->update_statements) {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+}
 
 int Database::Close() {
-    int rc; 
+    int rc = SQLITE_OK;
 
     if (this->db != nullptr) {
+        finalize_statements();
         rc = sqlite3_close(this->db);
     }
 
@@ -104,29 +853,36 @@ int Database::Close() {
         return rc;
     }
 
+    this->db = nullptr;
+
+    if (this->vfs != nullptr) {
+        EncryptedVFS::ClearKey(this->path);
+    }
+
     return rc;
 }
 
 std::vector<std::unique_ptr<Database::Entry>> Database::GetAll() {
     std::vector<std::unique_ptr<Database::Entry>> entries;
-    sqlite3_stmt *stmt = nullptr;
-    std::string sql = "SELECT * FROM secrets;";
+    sqlite3_stmt *stmt = statement(QUERY_SELECT_ALL);
 
-    int rc = sqlite3_prepare_v2(this->db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    if (stmt == nullptr) {
         throw std::runtime_error("Database error: " + std::string(sqlite3_errmsg(this->db)));
     }
 
+    StatementGuard guard(stmt);
+    int rc;
+
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
         std::unique_ptr<Database::Entry> entry(new Database::Entry());
 
         entry->id       = sqlite3_column_int(stmt, 0);
-        entry->title    = (const char*)sqlite3_column_text(stmt, 1);
-        entry->url      = (const char*)sqlite3_column_text(stmt, 2);
-        entry->username = (const char*)sqlite3_column_text(stmt, 3);
-        entry->password = (const char*)sqlite3_column_text(stmt, 4);
-        entry->category = (const char*)sqlite3_column_text(stmt, 5);
-        entry->notes    = (const char*)sqlite3_column_text(stmt, 6);
+        entry->title    = column_string(stmt, 1);
+        entry->url      = column_string(stmt, 2);
+        entry->username = column_string(stmt, 3);
+        entry->password = column_text(stmt, 4);
+        entry->category = column_string(stmt, 5);
+        entry->notes    = column_text(stmt, 6);
 
         entries.push_back(std::move(entry));
     }
@@ -135,28 +891,30 @@ std::vector<std::unique_ptr<Database::Entry>> Database::GetAll() {
         throw std::runtime_error("Database error: " + std::string(sqlite3_errmsg(this->db)));
     }
 
-    sqlite3_finalize(stmt);
     return entries;
 }
 
 
 std::vector<std::unique_ptr<Database::Entry>> Database::Filter(const std::string& query) {
     std::vector<std::unique_ptr<Database::Entry>> entries;
-    sqlite3_stmt *stmt = nullptr;
-    std::string sql = "SELECT * FROM secrets WHERE url LIKE ? OR title LIKE ? OR category LIKE ?";
+    sqlite3_stmt *stmt = statement(QUERY_FILTER);
     std::string wildcard_query = "%" + query + "%";
 
-    int rc = sqlite3_prepare_v2(this->db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    if (stmt == nullptr) {
         throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(this->db)));
     }
 
-    rc = sqlite3_bind_text(stmt, 1, wildcard_query.c_str(), -1, SQLITE_TRANSIENT);
-    if (rc != SQLITE_OK) {
-        sqlite3_finalize(stmt);
-        throw std::runtime_error("Failed to bind parameter: " + std::string(sqlite3_errmsg(this->db)));
+    StatementGuard guard(stmt);
+
+    for (int param = 1; param <= 3; param++) {
+        int rc = sqlite3_bind_text(stmt, param, wildcard_query.c_str(), -1, SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw std::runtime_error("Failed to bind parameter: " + std::string(sqlite3_errmsg(this->db)));
+        }
     }
 
+    int rc;
+
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
         std::unique_ptr<Database::Entry> entry(new Database::Entry());
 
@@ -172,15 +930,90 @@ std::vector<std::unique_ptr<Database::Entry>> Database::Filter(const std::string
     }
 
     if (rc != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw std::runtime_error("Execution failed: " + std::string(sqlite3_errmsg(this->db)));
     }
 
-    sqlite3_finalize(stmt);
     return entries;
 }
 
 
+std::vector<int> Database::Search(const std::string& query, int limit) {
+    std::vector<int> ids;
+    std::string match = fts_match_expression(query);
+
+    if (match.empty()) {
+        return ids;
+    }
+
+    // probe just past the ranking cutoff to find out whether this is a broad query.
+    if (!search_ids(QUERY_SEARCH, match, MAX_RANKED_RESULTS + 1, ids)) {
+        return ids;
+    }
+
+    bool broad = ids.size() > static_cast<size_t>(MAX_RANKED_RESULTS);
+
+    if (broad && (limit < 0 || static_cast<size_t>(limit) > ids.size())) {
+        ids.clear();
+        search_ids(QUERY_SEARCH, match, limit, ids);
+    } else if (!broad && ids.size() > 1) {
+        ids.clear();
+        search_ids(QUERY_RANKED_SEARCH, match, limit, ids);
+    } else if (limit >= 0 && ids.size() > static_cast<size_t>(limit)) {
+        ids.resize(limit);
+    }
+
+    return ids;
+}
+
+size_t Database::MaxRankedResults() {
+    return MAX_RANKED_RESULTS;
+}
+
+std::vector<std::string> Database::SearchTerms(const std::string& query) {
+    std::vector<std::string> terms;
+    std::string term;
+
+    for (size_t i = 0; i <= query.size(); i++) {
+        unsigned char c = i < query.size() ? query[i] : ' ';
+
+        // same separators as the unicode61 tokenizer for ascii, anything non-ascii is kept.
+        if (c >= 0x80 || std::isalnum(c)) {
+            term += static_cast<char>(c);
+        } else if (!term.empty()) {
+            terms.push_back(term);
+            term.clear();
+        }
+    }
+
+    return terms;
+}
+
+bool Database::search_ids(Query query, const std::string& match, int limit, std::vector<int>& ids) {
+    sqlite3_stmt *stmt = statement(query);
+
+    if (stmt == nullptr) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    StatementGuard guard(stmt);
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int(stmt, 0));
+    }
+
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Search failed: " << sqlite3_errmsg(this->db) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
 bool Database::ResetDB() {
     std::string sql = "DELETE FROM secrets;";
     char* errMsg = nullptr;
@@ -191,25 +1024,25 @@ bool Database::ResetDB() {
         return false;
     }
 
+    this->entries.clear();
+    this->categories.Clear();
+    this->generation++;
+
     return true;
 }
 
 std::unique_ptr<Database::Entry> Database::GetEntryById(int id) {
-    sqlite3_stmt *stmt = nullptr;
-    int rc;
-
-    const char *sql = "SELECT id, title, username, password, url, category, notes FROM secrets WHERE id = ?";
+    sqlite3_stmt *stmt = statement(QUERY_SELECT_BY_ID);
 
-    rc = sqlite3_prepare_v2(this->db, sql, -1, &stmt, nullptr);
-
-    if (rc != SQLITE_OK) {
+    if (stmt == nullptr) {
         std::cerr << "SQL error: " << sqlite3_errmsg(this->db) << std::endl;
         return nullptr;
     }
 
+    StatementGuard guard(stmt);
     sqlite3_bind_int(stmt, 1, id);
 
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
 
     if (rc == SQLITE_ROW) {
         int entry_id                  = sqlite3_column_int(stmt, 0);
@@ -225,12 +1058,11 @@ std::unique_ptr<Database::Entry> Database::GetEntryById(int id) {
             std::string(reinterpret_cast<const char*>(title)),
             std::string(reinterpret_cast<const char*>(url)),
             std::string(reinterpret_cast<const char*>(username)),
-            std::string(reinterpret_cast<const char*>(password)),
+            SecureString(reinterpret_cast<const char*>(password)),
             std::string(reinterpret_cast<const char*>(category)),
-            std::string(reinterpret_cast<const char*>(notes))
+            SecureString(reinterpret_cast<const char*>(notes))
         });
 
-        sqlite3_finalize(stmt);
         return entry;
     } else if (rc == SQLITE_DONE) {
         std::cout << "No entry found with ID " << id << std::endl;
@@ -238,33 +1070,103 @@ std::unique_ptr<Database::Entry> Database::GetEntryById(int id) {
         std::cerr << "Execution failed: " << sqlite3_errmsg(this->db) << std::endl;
     }
 
-    sqlite3_finalize(stmt);
     return nullptr;
 }
 
 bool Database::RemoveEntryById(int id) {
     bool didRemove = false;
-    sqlite3_stmt *stmt = nullptr;
-    int rc;
-    const char *sql = "DELETE FROM secrets WHERE id = ?";
+    sqlite3_stmt *stmt = statement(QUERY_DELETE_BY_ID);
 
-    rc = sqlite3_prepare_v2(this->db, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    if (stmt == nullptr) {
         throw std::runtime_error("Database error preparing SQL query: " + std::string(sqlite3_errmsg(this->db)));
     }
 
+    StatementGuard guard(stmt);
     sqlite3_bind_int(stmt, 1, id);
 
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
         throw std::runtime_error("Error executing SQL statement: " + std::string(sqlite3_errmsg(this->db)));
     } else {
         didRemove = true;
     }
 
-    sqlite3_finalize(stmt);
+    auto cached = find_cached(id);
+    if (cached != this->entries.end()) {
+        this->categories.Remove(id, cached->category);
+        this->entries.erase(cached);
+        this->generation++;
+    }
 
     return didRemove;
 }
 
+void Database::load_entries() {
+    sqlite3_stmt *stmt = statement(QUERY_SELECT_ALL);
+
+    if (stmt == nullptr) {
+        throw std::runtime_error("Database error: " + std::string(sqlite3_errmsg(this->db)));
+    }
+
+    StatementGuard guard(stmt);
+    int rc;
+
+    this->entries.clear();
+    this->categories.Clear();
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        Database::Entry entry;
+
+        entry.id       = sqlite3_column_int(stmt, 0);
+        entry.title    = column_string(stmt, 1);
+        entry.url      = column_string(stmt, 2);
+        entry.username = column_string(stmt, 3);
+        entry.password = column_text(stmt, 4);
+        entry.category = column_string(stmt, 5);
+        entry.notes    = column_text(stmt, 6);
+
+        this->categories.Add(entry.id, entry.category);
+        this->entries.push_back(std::move(entry));
+    }
+
+    if (rc != SQLITE_DONE) {
+        throw std::runtime_error("Database error: " + std::string(sqlite3_errmsg(this->db)));
+    }
+
+    this->generation++;
+}
+
+std::vector<Database::Entry>::iterator Database::find_cached(int id) {
+    auto it = std::lower_bound(this->entries.begin(), this->entries.end(), id,
+        [](const Database::Entry& e, int id) { return e.id < id; });
+
+    if (it != this->entries.end() && it->id == id) {
+        return it;
+    }
+
+    return this->entries.end();
+}
+
+const std::vector<Database::Entry>& Database::Entries() const {
+    return this->entries;
+}
+
+const Database::Entry* Database::CachedEntry(int id) const {
+    auto it = std::lower_bound(this->entries.begin(), this->entries.end(), id,
+        [](const Database::Entry& e, int id) { return e.id < id; });
+
+    if (it != this->entries.end() && it->id == id) {
+        return &(*it);
+    }
+
+    return nullptr;
+}
+
+const CategoryIndex& Database::Categories() const {
+    return this->categories;
+}
+
+unsigned long Database::Generation() const {
+    return this->generation;
+}
+
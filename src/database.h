@@ -6,6 +6,15 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include "encrypted_vfs.h"
+#include "secure_memory.h"
+#include "category_index.h"
 
 namespace CipherSafe
 {
@@ -15,24 +24,161 @@ namespace CipherSafe
     struct Entry
     {
       int id;
-      std::string title, url, username, password, category, notes;
+      std::string title, url, username;
+      SecureString password;
+      std::string category;
+      SecureString notes;
     };
 
-    Database(const std::string& path);
+    // column flags for UpdateFields()
+    enum Field {
+      FIELD_TITLE    = 1 << 0,
+      FIELD_URL      = 1 << 1,
+      FIELD_USERNAME = 1 << 2,
+      FIELD_PASSWORD = 1 << 3,
+      FIELD_CATEGORY = 1 << 4,
+      FIELD_NOTES    = 1 << 5,
+    };
+
+    /*
+     * how the connection trades durability for write latency, applied when it
+     * is opened. StorageProfile() has the named sets:
+     *
+     *   safe      WAL, every commit is fsynced (synchronous=FULL)
+     *   balanced  WAL, fsyncs only at checkpoints (synchronous=NORMAL), a power
+     *             loss can roll back the last few commits but never corrupts
+     *   fast      WAL, no fsyncs at all (synchronous=OFF), an OS crash or power
+     *             loss can corrupt the vault
+     *
+     * on an encrypted vault page_size, temp_store and mmap_size are fixed by
+     * EncryptedVFS and ignored here. in-memory images have nothing to tune.
+     */
+    struct StorageParams {
+      std::string journal_mode = "WAL";
+      std::string synchronous = "FULL";
+      int cache_size = -8192;   // pages, or KiB when negative (sqlite's convention)
+      long long mmap_size = 0;  // bytes, 0 = no memory mapped I/O
+      std::string temp_store = "MEMORY";
+      int page_size = 4096;     // only takes effect on a new database
+
+      StorageParams(); // safe
+    };
+
+    // "safe", "balanced" or "fast", anything else is "safe".
+    static StorageParams StorageProfile(const std::string& name);
+
+    // hands out the next entry to insert, false once there are no more.
+    typedef std::function<bool(Database::Entry& entry)> EntrySource;
+    // gets the number of rows inserted so far, returning false cancels the batch.
+    typedef std::function<bool(size_t added)> BatchProgress;
+
+    Database(const std::string& path, const StorageParams& storage = StorageParams());
+    // opens an in-memory database from a serialized image (empty image = new vault).
+    Database(const std::vector<unsigned char>& image);
+    /*
+     * opens (or creates) an on-disk vault through EncryptedVFS: every page is
+     * encrypted with `page_key`, so each commit is durable and only rewrites
+     * the pages it touched. throws if the key doesn't open the file.
+     */
+    Database(const std::string& path, const unsigned char page_key[EncryptedVFS::KEY_BYTES],
+             const StorageParams& storage = StorageParams());
+    // copies every secret out of a serialized image (e.g. a decrypted core.enc) into this database.
+    bool Import(const std::vector<unsigned char>& image);
     bool Add(std::unique_ptr<Database::Entry> entry);
+    /*
+     * bulk insert: every entry goes in through one reused statement inside a
+     * single transaction, so a whole import costs one commit instead of one
+     * per row. `progress` is called every few thousand rows; if it cancels, or
+     * `next` throws, nothing from the batch is kept.
+     */
+    bool AddBatch(const EntrySource& next, const BatchProgress& progress = nullptr);
+    bool AddBatch(const std::vector<Database::Entry>& batch, const BatchProgress& progress = nullptr);
     bool Update(Database::Entry* entry);
+    // writes only the columns flagged in `fields` (see Field) with a single UPDATE.
+    bool UpdateFields(const Database::Entry& entry, unsigned int fields);
     bool ResetDB();
     bool RemoveEntryById(int id);
     int Close();
+    /*
+     * hands the raw database image to `sink`. for an in-memory database the
+     * image is passed without making a copy first.
+     */
+    bool Serialize(const std::function<bool(const unsigned char*, size_t)>& sink);
     std::vector<std::unique_ptr<Database::Entry>> GetAll();
     std::vector<std::unique_ptr<Database::Entry>> Filter(const std::string& query);
     std::unique_ptr<Database::Entry> GetEntryById(int id);
 
+    /*
+     * prefix-aware full text search over title, url and category. returns
+     * matching entry ids, best match first (large result sets are returned in
+     * id order instead). a negative limit means no limit.
+     */
+    std::vector<int> Search(const std::string& query, int limit = -1);
+    // result sets up to this size are ranked.
+    static size_t MaxRankedResults();
+
+    // the current value of a pragma as sqlite reports it, e.g Pragma("journal_mode") == "wal".
+    std::string Pragma(const std::string& name);
+
+    // the schema version the vault is at (PRAGMA user_version), and the one this build migrates to.
+    int SchemaVersion();
+    static int LatestSchemaVersion();
+
+    // splits search box text into the terms Search() matches on.
+    static std::vector<std::string> SearchTerms(const std::string& query);
+
+    /*
+     * In-memory mirror of the secrets table, filled once at open and kept
+     * up to date by Add/Update/RemoveEntryById/ResetDB. Generation() is
+     * bumped on every mutation so callers can tell when to rebuild views.
+     */
+    const std::vector<Database::Entry>& Entries() const;
+    const Database::Entry* CachedEntry(int id) const;
+    unsigned long Generation() const;
+    // the cached entries' ids by category, kept up to date alongside them.
+    const CategoryIndex& Categories() const;
+
   private:
     const std::string path;
-    sqlite3* db;
+    sqlite3* db = nullptr;
+    const char* vfs = nullptr; // nullptr = sqlite's default vfs
+    std::vector<Database::Entry> entries; // ordered by id
+    CategoryIndex categories;
+    unsigned long generation = 0;
+
+    // the fixed queries, their SQL is in database.cpp.
+    enum Query {
+      QUERY_INSERT,
+      QUERY_UPDATE,
+      QUERY_SELECT_ALL,
+      QUERY_FILTER,
+      QUERY_SELECT_BY_ID,
+      QUERY_DELETE_BY_ID,
+      QUERY_SEARCH,
+      QUERY_RANKED_SEARCH,
+      QUERY_INDEX_BATCH,
+      QUERY_COUNT
+    };
+    // one UpdateFields() statement per combination of FIELD_* flags.
+    static const unsigned int UPDATE_COMBINATIONS = FIELD_NOTES << 1;
+
+    sqlite3_stmt* statements[QUERY_COUNT] = {};
+    sqlite3_stmt* update_statements[UPDATE_COMBINATIONS] = {}; // prepared on first use
     int create_tables();
+    bool table_exists(const std::string& name);
+    bool index_batch(int first_id);
+    bool search_ids(Query query, const std::string& match, int limit, std::vector<int>& ids);
     void init_db();
+    void deserialize(const std::vector<unsigned char>& image, const char* schema = "main");
+    void configure_encryption();
+    void configure_storage(const StorageParams& storage);
+    void migrate();
+    void prepare_statements();
+    void finalize_statements();
+    sqlite3_stmt* statement(Query query);
+    sqlite3_stmt* prepare(const char* sql);
+    void load_entries();
+    std::vector<Database::Entry>::iterator find_cached(int id);
   };
 }
 #endif
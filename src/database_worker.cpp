@@ -0,0 +1,232 @@
+#include "database_worker.h"
+
+using namespace CipherSafe;
+
+DatabaseWorker::DatabaseWorker(std::unique_ptr<Database> db, const std::function<void()>& wake):
+    db(std::move(db)), wake(wake), queued(0), outstanding(0) {
+    // the mirror starts as a copy, before the worker owns the database.
+    this->entries = this->db->Entries();
+    this->categories = this->db->Categories();
+    this->generation = 1;
+
+    this->thread = std::thread(&DatabaseWorker::run, this);
+}
+
+DatabaseWorker::~DatabaseWorker() {
+    if (this->thread.joinable()) {
+        Close();
+    }
+}
+
+void DatabaseWorker::Post(const Work& work, const Done& done) {
+    std::unique_ptr<Command> command(new Command());
+    command->work = work;
+    command->done = done;
+
+    this->outstanding++;
+
+    // counted before it is pushed so the count never drops below what is in the queue. the lock
+    // is only there so the worker can't miss the wakeup between checking and going to sleep.
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->queued++;
+    }
+
+    this->commands.Push(std::move(command));
+    this->wakeup.notify_one();
+}
+
+void DatabaseWorker::Add(std::unique_ptr<Database::Entry> entry, const Done& done) {
+    // std::function has to be copyable, unique_ptr isn't.
+    std::shared_ptr<Database::Entry> shared(entry.release());
+
+    Post([shared](Database& db, Result& result) {
+        if (!db.Add(std::unique_ptr<Database::Entry>(new Database::Entry(std::move(*shared))))) {
+            return false;
+        }
+
+        // rowids only grow, the new entry is the last one.
+        result.id = db.Entries().back().id;
+        result.changed.push_back(db.Entries().back());
+        return true;
+    }, done);
+}
+
+void DatabaseWorker::UpdateFields(const Database::Entry& entry, unsigned int fields, const Done& done) {
+    Database::Entry copy = entry;
+
+    Post([copy, fields](Database& db, Result& result) {
+        if (!db.UpdateFields(copy, fields)) {
+            return false;
+        }
+
+        const Database::Entry* updated = db.CachedEntry(copy.id);
+        if (updated != nullptr) {
+            result.changed.push_back(*updated);
+        }
+        return true;
+    }, done);
+}
+
+void DatabaseWorker::RemoveEntryById(int id, const Done& done) {
+    Post([id](Database& db, Result& result) {
+        if (!db.RemoveEntryById(id)) {
+            return false;
+        }
+
+        result.removed.push_back(id);
+        return true;
+    }, done);
+}
+
+void DatabaseWorker::AddBatch(const Database::EntrySource& next, const Database::BatchProgress& progress, const Done& done) {
+    Post([next, progress](Database& db, Result& result) {
+        if (!db.AddBatch(next, progress)) {
+            return false;
+        }
+
+        result.reload = true;
+        result.changed = db.Entries();
+        return true;
+    }, done);
+}
+
+void DatabaseWorker::Search(const std::string& query, const Done& done) {
+    Post([query](Database& db, Result& result) {
+        result.ids = db.Search(query);
+        return true;
+    }, done);
+}
+
+void DatabaseWorker::run() {
+    for (;;) {
+        std::unique_ptr<Command> command;
+
+        if (!this->commands.Pop(command)) {
+            std::unique_lock<std::mutex> lock(this->mutex);
+
+            if (this->stopping && this->queued == 0) {
+                return;
+            }
+
+            // a push in progress is counted before Pop() can see it, that just goes round again.
+            this->wakeup.wait(lock, [this] { return this->queued > 0 || this->stopping; });
+            continue;
+        }
+
+        command->result.ok = command->work(*this->db, command->result);
+        this->completions.Push(std::move(command));
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->queued--;
+        }
+        this->idle.notify_all();
+
+        if (this->wake) {
+            this->wake();
+        }
+    }
+}
+
+size_t DatabaseWorker::Drain() {
+    size_t drained = 0;
+    std::unique_ptr<Command> command;
+
+    while (this->completions.Pop(command)) {
+        apply(command->result);
+
+        if (command->done) {
+            command->done(command->result);
+        }
+
+        this->outstanding--;
+        drained++;
+    }
+
+    return drained;
+}
+
+bool DatabaseWorker::Busy() const {
+    return this->outstanding > 0;
+}
+
+void DatabaseWorker::Wait() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->idle.wait(lock, [this] { return this->queued == 0; });
+}
+
+int DatabaseWorker::Close() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wakeup.notify_one();
+
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+
+    Drain();
+    return this->db->Close();
+}
+
+void DatabaseWorker::apply(Result& result) {
+    if (result.reload) {
+        this->entries.swap(result.changed);
+        result.changed.clear();
+
+        this->categories.Clear();
+        for (const auto& entry : this->entries) {
+            this->categories.Add(entry.id, entry.category);
+        }
+        this->generation++;
+        return;
+    }
+
+    for (auto& entry : result.changed) {
+        auto pos = std::lower_bound(this->entries.begin(), this->entries.end(), entry.id,
+            [](const Database::Entry& e, int id) { return e.id < id; });
+
+        if (pos != this->entries.end() && pos->id == entry.id) {
+            this->categories.Move(entry.id, pos->category, entry.category);
+            *pos = std::move(entry);
+        } else {
+            this->categories.Add(entry.id, entry.category);
+            this->entries.insert(pos, std::move(entry));
+        }
+    }
+
+    for (int id : result.removed) {
+        auto pos = std::lower_bound(this->entries.begin(), this->entries.end(), id,
+            [](const Database::Entry& e, int id) { return e.id < id; });
+
+        if (pos != this->entries.end() && pos->id == id) {
+            this->categories.Remove(id, pos->category);
+            this->entries.erase(pos);
+        }
+    }
+
+    if (!result.changed.empty() || !result.removed.empty()) {
+        this->generation++;
+    }
+}
+
+const std::vector<Database::Entry>& DatabaseWorker::Entries() const {
+    return this->entries;
+}
+
+const Database::Entry* DatabaseWorker::CachedEntry(int id) const {
+    auto pos = std::lower_bound(this->entries.begin(), this->entries.end(), id,
+        [](const Database::Entry& e, int id) { return e.id < id; });
+
+    return pos != this->entries.end() && pos->id == id ? &*pos : nullptr;
+}
+
+const CategoryIndex& DatabaseWorker::Categories() const {
+    return this->categories;
+}
+
+unsigned long DatabaseWorker::Generation() const {
+    return this->generation;
+}
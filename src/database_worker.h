@@ -0,0 +1,104 @@
+#ifndef DATABASE_WORKER_H
+#define DATABASE_WORKER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+#include "database.h"
+#include "mpsc_queue.h"
+
+namespace CipherSafe {
+
+  /*
+   * runs every Database call on a thread of its own, so a slow commit (an
+   * fsync, a backup holding the lock) never stalls a frame. the worker owns
+   * the Database and its sqlite3 handle, everyone else posts commands.
+   *
+   * commands go in through a lock-free queue and run in the order they were
+   * posted. their results queue up the same way and are handed to the `done`
+   * callbacks by Drain(), on the thread calling it (the UI thread, once a
+   * frame). Drain() also applies the changes to a mirror of the entry cache
+   * and its category index, which is what Entries()/CachedEntry()/
+   * Generation()/Categories() read, so the UI never touches the worker's copy.
+   */
+  class DatabaseWorker {
+  public:
+    struct Result {
+      bool ok = false;
+      int id = 0;                           // the entry Add() inserted
+      std::vector<Database::Entry> changed; // added or updated, moved into the mirror before `done` runs
+      std::vector<int> removed;             // ids of removed entries
+      bool reload = false;                  // `changed` is the whole table
+      std::vector<int> ids;                 // Search() matches, best match first
+    };
+
+    typedef std::function<void(const Result& result)> Done;
+    typedef std::function<bool(Database& db, Result& result)> Work;
+
+    // `wake` is called on the worker after every command, e.g to wake an idle event loop.
+    DatabaseWorker(std::unique_ptr<Database> db, const std::function<void()>& wake = nullptr);
+    ~DatabaseWorker();
+
+    void Add(std::unique_ptr<Database::Entry> entry, const Done& done = nullptr);
+    void UpdateFields(const Database::Entry& entry, unsigned int fields, const Done& done = nullptr);
+    void RemoveEntryById(int id, const Done& done = nullptr);
+    // `next` and `progress` are called on the worker.
+    void AddBatch(const Database::EntrySource& next, const Database::BatchProgress& progress, const Done& done = nullptr);
+    void Search(const std::string& query, const Done& done);
+    // anything else: `work` gets the database on the worker.
+    void Post(const Work& work, const Done& done = nullptr);
+
+    // runs the callbacks of finished commands, returns how many ran.
+    size_t Drain();
+    // true while a posted command hasn't been drained yet.
+    bool Busy() const;
+    // blocks until every command posted so far has run (drained or not).
+    void Wait();
+    // runs what is still queued, stops the worker, drains and closes the database.
+    int Close();
+
+    const std::vector<Database::Entry>& Entries() const;
+    const Database::Entry* CachedEntry(int id) const;
+    unsigned long Generation() const;
+    const CategoryIndex& Categories() const;
+
+  private:
+    struct Command {
+      Work work;
+      Done done;
+      Result result;
+    };
+
+    DatabaseWorker(const DatabaseWorker&);
+    DatabaseWorker& operator=(const DatabaseWorker&);
+
+    std::unique_ptr<Database> db; // the worker's, once it runs
+    std::function<void()> wake;
+    std::thread thread;
+
+    MpscQueue<std::unique_ptr<Command>> commands;
+    MpscQueue<std::unique_ptr<Command>> completions;
+    std::atomic<size_t> queued;      // posted, not run yet
+    std::atomic<size_t> outstanding; // posted, not drained yet
+
+    // only park the idle worker (and Wait()), the queues don't need them.
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    bool stopping = false;
+
+    // the UI side copy of the entry cache, ordered by id.
+    std::vector<Database::Entry> entries;
+    CategoryIndex categories;
+    unsigned long generation = 0;
+
+    void run();
+    void apply(Result& result);
+  };
+}
+#endif
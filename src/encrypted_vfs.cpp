@@ -0,0 +1,461 @@
+#include "encrypted_vfs.h"
+
+using namespace CipherSafe;
+
+const char* EncryptedVFS::NAME = "ciphersafe";
+
+/*
+ * page layout on disk:
+ *
+ *   ciphertext[PAGE_SIZE - RESERVE_BYTES] | nonce[24] | tag[16]
+ *
+ * SQLite never looks at the reserved bytes, so the nonce and tag can live
+ * there and a page still maps 1:1 onto a file offset. A fresh nonce is drawn
+ * on every write; main database pages also bind their page number as
+ * additional data so pages can't be swapped around inside the file.
+ */
+static const int PAGE_SIZE     = EncryptedVFS::PAGE_SIZE;
+static const int PAYLOAD_BYTES = EncryptedVFS::PAGE_SIZE - EncryptedVFS::RESERVE_BYTES;
+static const int NONCE_BYTES   = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+static const int WAL_FRAME_HEADER_BYTES = 24;
+
+typedef std::array<unsigned char, EncryptedVFS::KEY_BYTES> PageKey;
+
+enum FileKind {
+    FILE_PASSTHROUGH,
+    FILE_MAIN_DB,
+    FILE_JOURNAL,
+    FILE_WAL,
+};
+
+struct VaultFile {
+    sqlite3_file base;     // must stay first, SQLite only knows about this part
+    sqlite3_file* real;    // the default VFS's file, allocated right behind this struct
+    FileKind kind;
+    unsigned char* page;   // scratch page for encrypting writes / partial reads
+    PageKey key;
+};
+
+// szOsFile is sizeof(VaultFile) rounded up so `real` stays 8-byte aligned.
+static const int VAULT_FILE_BYTES = (sizeof(VaultFile) + 7) & ~7;
+
+static std::mutex key_mutex;
+static std::map<std::string, PageKey> keys; // keyed by full database path
+
+static sqlite3_vfs* real_vfs(sqlite3_vfs* vfs) {
+    return static_cast<sqlite3_vfs*>(vfs->pAppData);
+}
+
+static std::string full_path(const std::string& path) {
+    sqlite3_vfs* vfs = sqlite3_vfs_find(nullptr);
+    std::vector<char> buffer(vfs->mxPathname + 1);
+
+    if (vfs->xFullPathname(vfs, path.c_str(), static_cast<int>(buffer.size()), buffer.data()) != SQLITE_OK) {
+        return path;
+    }
+
+    return std::string(buffer.data());
+}
+
+static bool lookup_key(const char* db_path, PageKey& key) {
+    std::lock_guard<std::mutex> lock(key_mutex);
+
+    auto it = keys.find(db_path);
+    if (it == keys.end()) {
+        return false;
+    }
+
+    key = it->second;
+    return true;
+}
+
+static void page_number_ad(unsigned char ad[8], sqlite3_int64 offset) {
+    sqlite3_uint64 page_number = offset / PAGE_SIZE + 1;
+    for (int i = 0; i < 8; i++) {
+        ad[i] = static_cast<unsigned char>(page_number >> (8 * i));
+    }
+}
+
+static void seal_page(VaultFile* file, unsigned char* page, sqlite3_int64 offset) {
+    unsigned char ad[8];
+    page_number_ad(ad, offset);
+    bool bind_page = file->kind == FILE_MAIN_DB;
+
+    unsigned char* nonce = page + PAYLOAD_BYTES;
+    randombytes_buf(nonce, NONCE_BYTES);
+
+    crypto_aead_xchacha20poly1305_ietf_encrypt_detached(
+        page, nonce + NONCE_BYTES, nullptr, page, PAYLOAD_BYTES,
+        bind_page ? ad : nullptr, bind_page ? sizeof(ad) : 0, nullptr, nonce, file->key.data());
+}
+
+static bool open_page(VaultFile* file, unsigned char* page, sqlite3_int64 offset) {
+    unsigned char ad[8];
+    page_number_ad(ad, offset);
+    bool bind_page = file->kind == FILE_MAIN_DB;
+
+    unsigned char* nonce = page + PAYLOAD_BYTES;
+
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt_detached(
+            page, nullptr, page, PAYLOAD_BYTES, nonce + NONCE_BYTES,
+            bind_page ? ad : nullptr, bind_page ? sizeof(ad) : 0, nonce, file->key.data()) != 0) {
+        return false;
+    }
+
+    /*
+     * the WAL and journal checksum whole pages, reserved bytes included. SQLite
+     * zero fills pages it creates, so handing every page back with zeroed
+     * reserved bytes makes those checksums come out the same after a reread.
+     */
+    std::memset(nonce, 0, EncryptedVFS::RESERVE_BYTES);
+    return true;
+}
+
+/*
+ * SQLite reads the main database header in small pieces (100 bytes at
+ * offset 0, 16 bytes at offset 24, ...). Those are served from the
+ * decrypted page that contains them.
+ */
+static int read_partial(VaultFile* file, unsigned char* out, int amount, sqlite3_int64 offset) {
+    while (amount > 0) {
+        sqlite3_int64 page_offset = offset - offset % PAGE_SIZE;
+        int skip = static_cast<int>(offset - page_offset);
+        int length = std::min(amount, PAGE_SIZE - skip);
+
+        int rc = file->real->pMethods->xRead(file->real, file->page, PAGE_SIZE, page_offset);
+        if (rc == SQLITE_IOERR_SHORT_READ) {
+            // nothing (complete) on disk yet, same as reading past the end.
+            std::memset(out, 0, amount);
+            return rc;
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        if (!open_page(file, file->page, page_offset)) {
+            return SQLITE_IOERR_DATA;
+        }
+
+        std::memcpy(out, file->page + skip, length);
+        out += length;
+        offset += length;
+        amount -= length;
+    }
+
+    return SQLITE_OK;
+}
+
+static int vault_close(sqlite3_file* base) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    int rc = file->real->pMethods ? file->real->pMethods->xClose(file->real) : SQLITE_OK;
+
+    if (file->page != nullptr) {
+        sodium_memzero(file->page, PAGE_SIZE);
+        sqlite3_free(file->page);
+        file->page = nullptr;
+    }
+    sodium_memzero(file->key.data(), file->key.size());
+
+    return rc;
+}
+
+static int vault_read(sqlite3_file* base, void* buffer, int amount, sqlite3_int64 offset) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    unsigned char* out = static_cast<unsigned char*>(buffer);
+
+    if (file->kind == FILE_MAIN_DB && (amount != PAGE_SIZE || offset % PAGE_SIZE != 0)) {
+        return read_partial(file, out, amount, offset);
+    }
+
+    int rc = file->real->pMethods->xRead(file->real, buffer, amount, offset);
+    if (rc != SQLITE_OK || file->kind == FILE_PASSTHROUGH) {
+        return rc;
+    }
+
+    // WAL recovery reads whole frames: a 24 byte frame header followed by the page.
+    unsigned char* page = nullptr;
+    if (amount == PAGE_SIZE) {
+        page = out;
+    } else if (file->kind == FILE_WAL && amount == WAL_FRAME_HEADER_BYTES + PAGE_SIZE) {
+        page = out + WAL_FRAME_HEADER_BYTES;
+    }
+
+    if (page != nullptr && !open_page(file, page, offset)) {
+        return SQLITE_IOERR_DATA;
+    }
+
+    return SQLITE_OK;
+}
+
+static int vault_write(sqlite3_file* base, const void* buffer, int amount, sqlite3_int64 offset) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+
+    if (file->kind == FILE_PASSTHROUGH || amount != PAGE_SIZE) {
+        // headers of the journal and WAL carry no row data. a main database
+        // write that isn't a whole page would land on disk as plaintext.
+        if (file->kind == FILE_MAIN_DB) {
+            return SQLITE_IOERR_WRITE;
+        }
+        return file->real->pMethods->xWrite(file->real, buffer, amount, offset);
+    }
+
+    std::memcpy(file->page, buffer, PAGE_SIZE);
+
+    // page 1 byte 20 is the reserved space per page, without room for the nonce and tag we'd clobber data.
+    if (file->kind == FILE_MAIN_DB && offset == 0 && file->page[20] < EncryptedVFS::RESERVE_BYTES) {
+        return SQLITE_IOERR_WRITE;
+    }
+
+    seal_page(file, file->page, offset);
+
+    return file->real->pMethods->xWrite(file->real, file->page, PAGE_SIZE, offset);
+}
+
+static int vault_truncate(sqlite3_file* base, sqlite3_int64 size) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xTruncate(file->real, size);
+}
+
+static int vault_sync(sqlite3_file* base, int flags) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xSync(file->real, flags);
+}
+
+static int vault_file_size(sqlite3_file* base, sqlite3_int64* size) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xFileSize(file->real, size);
+}
+
+static int vault_lock(sqlite3_file* base, int lock) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xLock(file->real, lock);
+}
+
+static int vault_unlock(sqlite3_file* base, int lock) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xUnlock(file->real, lock);
+}
+
+static int vault_check_reserved_lock(sqlite3_file* base, int* result) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xCheckReservedLock(file->real, result);
+}
+
+static int vault_file_control(sqlite3_file* base, int op, void* arg) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+
+    if (op == SQLITE_FCNTL_VFSNAME && file->real->pMethods->xFileControl(file->real, op, arg) == SQLITE_OK) {
+        char* real_name = *static_cast<char**>(arg);
+        *static_cast<char**>(arg) = sqlite3_mprintf("%s/%z", EncryptedVFS::NAME, real_name);
+        return SQLITE_OK;
+    }
+
+    return file->real->pMethods->xFileControl(file->real, op, arg);
+}
+
+/*
+ * the journal header is written in sector sized pieces. Reporting 512 keeps
+ * those writes from ever being the size of a page (and getting encrypted).
+ */
+static int vault_sector_size(sqlite3_file* base) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return std::min(512, file->real->pMethods->xSectorSize(file->real));
+}
+
+/*
+ * powersafe overwrite stops the WAL from padding commits to a sector
+ * boundary, which would otherwise split a page write in two.
+ */
+static int vault_device_characteristics(sqlite3_file* base) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xDeviceCharacteristics(file->real) | SQLITE_IOCAP_POWERSAFE_OVERWRITE;
+}
+
+static int vault_shm_map(sqlite3_file* base, int region, int size, int extend, void volatile** out) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xShmMap(file->real, region, size, extend, out);
+}
+
+static int vault_shm_lock(sqlite3_file* base, int offset, int n, int flags) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xShmLock(file->real, offset, n, flags);
+}
+
+static void vault_shm_barrier(sqlite3_file* base) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    file->real->pMethods->xShmBarrier(file->real);
+}
+
+static int vault_shm_unmap(sqlite3_file* base, int delete_flag) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    return file->real->pMethods->xShmUnmap(file->real, delete_flag);
+}
+
+// version 2: no xFetch/xUnfetch, so SQLite never maps (still encrypted) pages straight into memory.
+static const sqlite3_io_methods vault_io_methods = {
+    2,
+    vault_close,
+    vault_read,
+    vault_write,
+    vault_truncate,
+    vault_sync,
+    vault_file_size,
+    vault_lock,
+    vault_unlock,
+    vault_check_reserved_lock,
+    vault_file_control,
+    vault_sector_size,
+    vault_device_characteristics,
+    vault_shm_map,
+    vault_shm_lock,
+    vault_shm_barrier,
+    vault_shm_unmap,
+    nullptr,
+    nullptr,
+};
+
+static int vault_open(sqlite3_vfs* vfs, const char* name, sqlite3_file* base, int flags, int* out_flags) {
+    VaultFile* file = reinterpret_cast<VaultFile*>(base);
+    std::memset(file, 0, sizeof(VaultFile));
+    file->real = reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(file) + VAULT_FILE_BYTES);
+    file->kind = FILE_PASSTHROUGH;
+
+    if (flags & SQLITE_OPEN_MAIN_DB) {
+        file->kind = FILE_MAIN_DB;
+    } else if (flags & SQLITE_OPEN_MAIN_JOURNAL) {
+        file->kind = FILE_JOURNAL;
+    } else if (flags & SQLITE_OPEN_WAL) {
+        file->kind = FILE_WAL;
+    }
+
+    if (file->kind != FILE_PASSTHROUGH) {
+        const char* db_path = file->kind == FILE_MAIN_DB ? name : sqlite3_filename_database(name);
+        if (name == nullptr || !lookup_key(db_path, file->key)) {
+            return SQLITE_CANTOPEN;
+        }
+
+        file->page = static_cast<unsigned char*>(sqlite3_malloc(PAGE_SIZE));
+        if (file->page == nullptr) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+    sqlite3_vfs* real = real_vfs(vfs);
+    int rc = real->xOpen(real, name, file->real, flags, out_flags);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(file->page);
+        file->page = nullptr;
+        return rc;
+    }
+
+    file->base.pMethods = &vault_io_methods;
+    return SQLITE_OK;
+}
+
+static int vault_delete(sqlite3_vfs* vfs, const char* name, int sync_dir) {
+    return real_vfs(vfs)->xDelete(real_vfs(vfs), name, sync_dir);
+}
+
+static int vault_access(sqlite3_vfs* vfs, const char* name, int flags, int* result) {
+    return real_vfs(vfs)->xAccess(real_vfs(vfs), name, flags, result);
+}
+
+static int vault_full_pathname(sqlite3_vfs* vfs, const char* name, int size, char* out) {
+    return real_vfs(vfs)->xFullPathname(real_vfs(vfs), name, size, out);
+}
+
+static void* vault_dl_open(sqlite3_vfs* vfs, const char* filename) {
+    return real_vfs(vfs)->xDlOpen(real_vfs(vfs), filename);
+}
+
+static void vault_dl_error(sqlite3_vfs* vfs, int size, char* out) {
+    real_vfs(vfs)->xDlError(real_vfs(vfs), size, out);
+}
+
+static void (*vault_dl_sym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void) {
+    return real_vfs(vfs)->xDlSym(real_vfs(vfs), handle, symbol);
+}
+
+static void vault_dl_close(sqlite3_vfs* vfs, void* handle) {
+    real_vfs(vfs)->xDlClose(real_vfs(vfs), handle);
+}
+
+static int vault_randomness(sqlite3_vfs* vfs, int size, char* out) {
+    return real_vfs(vfs)->xRandomness(real_vfs(vfs), size, out);
+}
+
+static int vault_sleep(sqlite3_vfs* vfs, int microseconds) {
+    return real_vfs(vfs)->xSleep(real_vfs(vfs), microseconds);
+}
+
+static int vault_current_time(sqlite3_vfs* vfs, double* now) {
+    return real_vfs(vfs)->xCurrentTime(real_vfs(vfs), now);
+}
+
+static int vault_get_last_error(sqlite3_vfs* vfs, int size, char* out) {
+    return real_vfs(vfs)->xGetLastError ? real_vfs(vfs)->xGetLastError(real_vfs(vfs), size, out) : 0;
+}
+
+static int vault_current_time_int64(sqlite3_vfs* vfs, sqlite3_int64* now) {
+    return real_vfs(vfs)->xCurrentTimeInt64(real_vfs(vfs), now);
+}
+
+bool EncryptedVFS::Register() {
+    static sqlite3_vfs vfs;
+    static std::once_flag registered;
+    static int rc = SQLITE_OK;
+
+    std::call_once(registered, []() {
+        sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+        if (real == nullptr) {
+            rc = SQLITE_ERROR;
+            return;
+        }
+
+        std::memset(&vfs, 0, sizeof(vfs));
+        vfs.iVersion          = 2;
+        vfs.szOsFile          = VAULT_FILE_BYTES + real->szOsFile;
+        vfs.mxPathname        = real->mxPathname;
+        vfs.zName             = NAME;
+        vfs.pAppData          = real;
+        vfs.xOpen             = vault_open;
+        vfs.xDelete           = vault_delete;
+        vfs.xAccess           = vault_access;
+        vfs.xFullPathname     = vault_full_pathname;
+        vfs.xDlOpen           = vault_dl_open;
+        vfs.xDlError          = vault_dl_error;
+        vfs.xDlSym            = vault_dl_sym;
+        vfs.xDlClose          = vault_dl_close;
+        vfs.xRandomness       = vault_randomness;
+        vfs.xSleep            = vault_sleep;
+        vfs.xCurrentTime      = vault_current_time;
+        vfs.xGetLastError     = vault_get_last_error;
+        vfs.xCurrentTimeInt64 = vault_current_time_int64;
+
+        rc = sqlite3_vfs_register(&vfs, 0);
+    });
+
+    if (rc != SQLITE_OK) {
+        std::cerr << "Failed to register the encrypted vfs: " << sqlite3_errstr(rc) << std::endl;
+    }
+
+    return rc == SQLITE_OK;
+}
+
+void EncryptedVFS::SetKey(const std::string& db_path, const unsigned char key[KEY_BYTES]) {
+    PageKey page_key;
+    std::memcpy(page_key.data(), key, KEY_BYTES);
+
+    std::lock_guard<std::mutex> lock(key_mutex);
+    keys[full_path(db_path)] = page_key;
+    sodium_memzero(page_key.data(), page_key.size());
+}
+
+void EncryptedVFS::ClearKey(const std::string& db_path) {
+    std::lock_guard<std::mutex> lock(key_mutex);
+
+    auto it = keys.find(full_path(db_path));
+    if (it != keys.end()) {
+        sodium_memzero(it->second.data(), it->second.size());
+        keys.erase(it);
+    }
+}
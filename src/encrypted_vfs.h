@@ -0,0 +1,42 @@
+#ifndef ENCRYPTED_VFS_H
+#define ENCRYPTED_VFS_H
+
+#include <sqlite3.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <array>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <sodium.h>
+
+namespace CipherSafe {
+
+  /*
+   * A SQLite VFS that wraps the default one and encrypts + authenticates
+   * every database page on its way to disk (XChaCha20-Poly1305). Each page
+   * reserves its last RESERVE_BYTES for its own nonce and tag, so a commit
+   * only rewrites the pages it touched instead of the whole vault.
+   *
+   * Page images in the rollback journal and the WAL are encrypted the same
+   * way. Other temp files pass through untouched, so connections using this
+   * VFS must keep temp_store=MEMORY. Memory mapped I/O is never offered.
+   */
+  class EncryptedVFS {
+  public:
+    static const char* NAME;
+    static const int PAGE_SIZE = 4096;
+    static const int RESERVE_BYTES = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    static const int KEY_BYTES = crypto_aead_xchacha20poly1305_ietf_KEYBYTES;
+
+    // registers the VFS with SQLite (once), without making it the default.
+    static bool Register();
+
+    // the page key used for the database at `db_path` and its journal/WAL.
+    static void SetKey(const std::string& db_path, const unsigned char key[KEY_BYTES]);
+    static void ClearKey(const std::string& db_path);
+  };
+}
+#endif
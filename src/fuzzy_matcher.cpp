@@ -0,0 +1,530 @@
+#include "fuzzy_matcher.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FUZZY_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace CipherSafe;
+
+// the same scale fzf scores on.
+static const int SCORE_MATCH         = 16;
+static const int SCORE_GAP_START     = -3;
+static const int SCORE_GAP_EXTENSION = -1;
+static const int BONUS_BOUNDARY      = SCORE_MATCH / 2; // first character of a word
+static const int BONUS_CONSECUTIVE   = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+static const int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+static const int BONUS_TITLE         = SCORE_MATCH;     // the term matched in the title
+static const int PENALTY_TYPO        = 2 * SCORE_MATCH; // per query character that wasn't found
+
+static const char FIELD_SEPARATOR = '\x1f';
+static const size_t PADDING = 32;   // one AVX2 load
+static const size_t MAX_TERM = 64;  // skipped characters are tracked in a 64 bit mask
+
+typedef void (*LowerFn)(const char* in, char* out, size_t length);
+typedef const char* (*FindFn)(const char* begin, const char* end, char c);
+
+struct Kernels {
+    LowerFn lower;
+    FindFn find;
+    const char* name;
+};
+
+static char lower_byte(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static void lower_scalar(const char* in, char* out, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        out[i] = lower_byte(in[i]);
+    }
+}
+
+#ifndef FUZZY_X86_KERNELS
+// memchr is usually vectorized by libc already.
+static const char* find_scalar(const char* begin, const char* end, char c) {
+    const void* at = std::memchr(begin, c, static_cast<size_t>(end - begin));
+    return at != nullptr ? static_cast<const char*>(at) : end;
+}
+#endif
+
+#ifdef FUZZY_X86_KERNELS
+/*
+ * A-Z gets 0x20 added, everything else (bytes >= 0x80 compare as negative)
+ * is left alone. the tails go through the scalar versions.
+ */
+static void lower_sse2(const char* in, char* out, size_t length) {
+    const __m128i before_a = _mm_set1_epi8('A' - 1);
+    const __m128i after_z = _mm_set1_epi8('Z' + 1);
+    const __m128i to_lower = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_a), _mm_cmplt_epi8(bytes, after_z));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi8(bytes, _mm_and_si128(upper, to_lower)));
+    }
+
+    lower_scalar(in + i, out + i, length - i);
+}
+
+/*
+ * the packed text has PADDING bytes after the last entry, so the finds read
+ * whole vectors past `end` and throw away what they hit there instead of
+ * finishing the (usually short) entry a byte at a time.
+ */
+static const char* find_sse2(const char* begin, const char* end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+
+    for (const char* p = begin; p < end; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int hits = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+
+        if (hits != 0) {
+            return std::min(p + __builtin_ctz(hits), end);
+        }
+    }
+
+    return end;
+}
+
+__attribute__((target("avx2")))
+static void lower_avx2(const char* in, char* out, size_t length) {
+    const __m256i before_a = _mm256_set1_epi8('A' - 1);
+    const __m256i after_z = _mm256_set1_epi8('Z' + 1);
+    const __m256i to_lower = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, before_a), _mm256_cmpgt_epi8(after_z, bytes));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi8(bytes, _mm256_and_si256(upper, to_lower)));
+    }
+
+    lower_sse2(in + i, out + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static const char* find_avx2(const char* begin, const char* end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+
+    for (const char* p = begin; p < end; p += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned int hits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle)));
+
+        if (hits != 0) {
+            return std::min(p + __builtin_ctz(hits), end);
+        }
+    }
+
+    return end;
+}
+#endif
+
+static Kernels pick_kernels() {
+#ifdef FUZZY_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { lower_avx2, find_avx2, "avx2" };
+    }
+    return { lower_sse2, find_sse2, "sse2" };
+#else
+    return { lower_scalar, find_scalar, "scalar" };
+#endif
+}
+
+static const Kernels& kernels() {
+    static const Kernels selected = pick_kernels();
+    return selected;
+}
+
+/*
+ * one bit per letter and digit, the rest of ascii shares 27 bits and
+ * anything non-ascii the last one. an entry can only match a term if it
+ * has (nearly) all of the term's bits.
+ */
+static uint64_t char_bit(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return 1ULL << (c - 'a');
+    if (c >= '0' && c <= '9') return 1ULL << (26 + c - '0');
+    if (c >= 0x80)            return 1ULL << 63;
+    return 1ULL << (36 + c % 27);
+}
+
+static uint64_t char_mask(const char* text, size_t length) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++) {
+        mask |= char_bit(static_cast<unsigned char>(text[i]));
+    }
+    return mask;
+}
+
+// without -mpopcnt std::bitset::count() is a library call, this is a couple of instructions per allowed bit.
+static bool more_bits_than(uint64_t bits, size_t allowed) {
+    for (size_t i = 0; i < allowed && bits != 0; i++) {
+        bits &= bits - 1;
+    }
+    return bits != 0;
+}
+
+static bool is_word_char(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    return uc >= 0x80 || (uc >= 'a' && uc <= 'z') || (uc >= '0' && uc <= '9');
+}
+
+struct Term {
+    std::string text; // lowercased
+    uint64_t mask;
+    size_t typos;     // characters it may miss
+    int bound;        // the best score it can get
+    int typo_bound;   // the best score it can get once it has missed one
+    std::vector<uint64_t> positions; // per byte value, the bits of the term characters it matches
+};
+
+// every one of `found` characters on a word start, the first one doubled, in the title.
+static int best_score(size_t found) {
+    return static_cast<int>(found) * (SCORE_MATCH + BONUS_BOUNDARY) + BONUS_BOUNDARY * (BONUS_FIRST_CHAR_MULTIPLIER - 1) + BONUS_TITLE;
+}
+
+static std::vector<Term> parse_terms(const std::string& query) {
+    std::vector<Term> terms;
+    size_t i = 0;
+
+    while (i < query.size()) {
+        while (i < query.size() && (query[i] == ' ' || query[i] == '\t')) {
+            i++;
+        }
+
+        size_t start = i;
+        while (i < query.size() && query[i] != ' ' && query[i] != '\t') {
+            i++;
+        }
+
+        if (i > start) {
+            Term term;
+            term.text.resize(std::min(i - start, MAX_TERM));
+            lower_scalar(query.data() + start, &term.text[0], term.text.size());
+            term.mask = char_mask(term.text.data(), term.text.size());
+            term.typos = term.text.size() >= 8 ? 2 : term.text.size() >= 4 ? 1 : 0;
+            term.bound = best_score(term.text.size());
+            term.typo_bound = best_score(term.text.size() - 1) - PENALTY_TYPO;
+
+            term.positions.assign(256, 0);
+            for (size_t c = 0; c < term.text.size(); c++) {
+                term.positions[static_cast<unsigned char>(term.text[c])] |= 1ULL << c;
+            }
+            terms.push_back(term);
+        }
+    }
+
+    return terms;
+}
+
+struct Span {
+    const char* first = nullptr;
+    const char* last = nullptr;
+    uint64_t skipped = 0; // bit i: term character i wasn't matched
+};
+
+/*
+ * takes the earliest occurrence of every character, which is all a plain
+ * subsequence needs. with typos left to spend, taking a character can
+ * strand the rest of the term, so skipping it is tried as well.
+ */
+static bool find_span(const char* p, const char* end, const std::string& term, size_t i, size_t typos, FindFn find, Span& span) {
+    for (; i < term.size(); i++) {
+        const char* at = find(p, end, term[i]);
+
+        if (at != end && typos > 0) {
+            Span taken = span;
+            taken.first = span.first != nullptr ? span.first : at;
+            taken.last = at;
+
+            if (find_span(at + 1, end, term, i + 1, typos, find, taken)) {
+                span = taken;
+                return true;
+            }
+        }
+
+        if (at == end || typos > 0) {
+            if (typos == 0) {
+                return false;
+            }
+            typos--;
+            span.skipped |= 1ULL << i;
+            continue;
+        }
+
+        if (span.first == nullptr) {
+            span.first = at;
+        }
+        span.last = at;
+        p = at + 1;
+    }
+
+    return span.first != nullptr;
+}
+
+// fzf v1's score of the (already shortest) window from `start` to `last`.
+static int score_window(const char* text, const char* start, const char* last, const std::string& term) {
+    int score = 0;
+    int first_bonus = 0;
+    int consecutive = 0;
+    bool in_gap = false;
+    size_t j = 0;
+    char previous = start == text ? FIELD_SEPARATOR : start[-1];
+
+    for (const char* p = start; p <= last && j < term.size(); p++) {
+        if (*p == term[j]) {
+            int bonus = is_word_char(previous) ? 0 : BONUS_BOUNDARY;
+
+            if (consecutive == 0) {
+                first_bonus = bonus;
+            } else {
+                // a run keeps the bonus of the word start it began on.
+                if (bonus >= BONUS_BOUNDARY && bonus > first_bonus) {
+                    first_bonus = bonus;
+                }
+                bonus = std::max(std::max(bonus, first_bonus), BONUS_CONSECUTIVE);
+            }
+
+            score += SCORE_MATCH + (j == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus);
+            consecutive++;
+            in_gap = false;
+            j++;
+        } else {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            in_gap = true;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+
+        previous = *p;
+    }
+
+    return score;
+}
+
+/*
+ * how many of the term's characters `text` has in order (the longest
+ * common subsequence), one pass with the term as a bit vector (Hyyrö):
+ * the zero bits of `v` count the characters matched so far.
+ */
+static size_t common_subsequence(const char* text, const char* end, const Term& term) {
+    size_t length = term.text.size();
+    uint64_t all = length == 64 ? ~0ULL : (1ULL << length) - 1;
+    uint64_t v = all;
+
+    for (const char* p = text; p < end; p++) {
+        uint64_t matches = v & term.positions[static_cast<unsigned char>(*p)];
+        v = ((v + matches) | (v & ~matches)) & all;
+    }
+
+    return length - std::bitset<64>(v).count();
+}
+
+/*
+ * with `typos` 0 only the plain subsequence, which stops at the first
+ * character that isn't there. otherwise the term is allowed to miss some.
+ */
+static bool find_term(const char* text, const char* end, const Term& term, size_t typos, FindFn find, Span& span) {
+    span = Span();
+
+    // trying every way to spend the typos only pays off when they're known to be enough.
+    if (typos > 0 && common_subsequence(text, end, term) + typos < term.text.size()) {
+        return false;
+    }
+
+    return find_span(text, end, term.text, 0, typos, find, span);
+}
+
+static int score_term(const char* text, const char* title_end, const Term& term, const Span& span) {
+    std::string kept;
+    size_t typos = 0;
+    for (size_t i = 0; i < term.text.size() && span.skipped != 0; i++) {
+        if (span.skipped & (1ULL << i)) {
+            typos++;
+        } else {
+            kept += term.text[i];
+        }
+    }
+    const std::string& matched = span.skipped != 0 ? kept : term.text;
+
+    // walking back from the last character finds the shortest window ending there.
+    const char* start = span.last;
+    size_t j = matched.size();
+    for (const char* p = span.last; p >= span.first; p--) {
+        if (*p == matched[j - 1] && --j == 0) {
+            start = p;
+            break;
+        }
+    }
+
+    int score = score_window(text, start, span.last, matched) - static_cast<int>(typos) * PENALTY_TYPO;
+    if (start < title_end) {
+        score += BONUS_TITLE;
+    }
+
+    return score;
+}
+
+// "https://", "www." and the like are in nearly every url, matching on them is just noise.
+static size_t url_prefix(const std::string& url) {
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+
+    if (url.size() - start >= 4 && (url.compare(start, 4, "www.") == 0 || url.compare(start, 4, "WWW.") == 0)) {
+        start += 4;
+    }
+
+    return start;
+}
+
+void FuzzyMatcher::Build(const std::vector<Database::Entry>& entries) {
+    Clear();
+
+    size_t total = 0;
+    for (const auto& entry : entries) {
+        total += entry.title.size() + entry.url.size() + entry.username.size() + 2;
+    }
+
+    this->text.assign(total + PADDING, '\0');
+    this->offsets.reserve(entries.size() + 1);
+    this->title_ends.reserve(entries.size());
+    this->masks.reserve(entries.size());
+    this->ids.reserve(entries.size());
+
+    LowerFn lower = kernels().lower;
+    char* out = this->text.data();
+    size_t at = 0;
+
+    // title \x1f url \x1f username
+    for (const auto& entry : entries) {
+        size_t start = at;
+        this->offsets.push_back(static_cast<uint32_t>(start));
+
+        lower(entry.title.data(), out + at, entry.title.size());
+        at += entry.title.size();
+        this->title_ends.push_back(static_cast<uint32_t>(at));
+        out[at++] = FIELD_SEPARATOR;
+
+        size_t skip = url_prefix(entry.url);
+        lower(entry.url.data() + skip, out + at, entry.url.size() - skip);
+        at += entry.url.size() - skip;
+        out[at++] = FIELD_SEPARATOR;
+
+        lower(entry.username.data(), out + at, entry.username.size());
+        at += entry.username.size();
+
+        this->masks.push_back(char_mask(out + start, at - start));
+        this->ids.push_back(entry.id);
+    }
+
+    this->offsets.push_back(static_cast<uint32_t>(at));
+}
+
+void FuzzyMatcher::Clear() {
+    this->text.clear();
+    this->offsets.clear();
+    this->title_ends.clear();
+    this->masks.clear();
+    this->ids.clear();
+}
+
+size_t FuzzyMatcher::Size() const {
+    return this->ids.size();
+}
+
+std::vector<FuzzyMatcher::Match> FuzzyMatcher::Search(const std::string& query, size_t limit) const {
+    std::vector<Match> best;
+    std::vector<Term> terms = parse_terms(query);
+
+    if (terms.empty() || limit == 0) {
+        return best;
+    }
+
+    auto better = [](const Match& a, const Match& b) {
+        return a.score > b.score || (a.score == b.score && a.id < b.id);
+    };
+
+    FindFn find = kernels().find;
+    std::vector<Span> spans(terms.size());
+    best.reserve(limit);
+
+    // the most the terms from t on can still add.
+    std::vector<int> remaining(terms.size() + 1, 0);
+    for (size_t t = terms.size(); t-- > 0;) {
+        remaining[t] = remaining[t + 1] + terms[t].bound;
+    }
+
+    for (size_t i = 0; i < this->ids.size(); i++) {
+        // most entries are ruled out here without touching their text.
+        bool possible = true;
+        for (const auto& term : terms) {
+            if (more_bits_than(term.mask & ~this->masks[i], term.typos)) {
+                possible = false;
+                break;
+            }
+        }
+        if (!possible) {
+            continue;
+        }
+
+        const char* text = this->text.data() + this->offsets[i];
+        const char* end = this->text.data() + this->offsets[i + 1];
+        const char* title_end = this->text.data() + this->title_ends[i];
+        int bound = 0;
+        uint64_t missed = 0; // terms that only match with a typo, the first 64 may
+
+        for (size_t t = 0; t < terms.size() && possible; t++) {
+            if (find_term(text, end, terms[t], 0, find, spans[t])) {
+                // the window it gets scored on can't start before the span does.
+                bound += terms[t].bound - (spans[t].first >= title_end ? BONUS_TITLE : 0);
+            } else if (terms[t].typos > 0 && t < 64) {
+                missed |= 1ULL << t;
+                bound += terms[t].typo_bound;
+            } else {
+                possible = false;
+            }
+
+            // once there are enough results, anything that can't beat the weakest one isn't worth looking at further.
+            if (possible && best.size() == limit) {
+                Match at_best = { this->ids[i], bound + remaining[t + 1] };
+                possible = better(at_best, best.front());
+            }
+        }
+
+        for (size_t t = 0; t < terms.size() && possible && missed != 0; t++) {
+            if ((missed & (1ULL << t)) && !find_term(text, end, terms[t], terms[t].typos, find, spans[t])) {
+                possible = false;
+            }
+        }
+
+        int score = 0;
+        for (size_t t = 0; t < terms.size() && possible; t++) {
+            score += score_term(text, title_end, terms[t], spans[t]);
+        }
+
+        // a scattered match with typos ends up below zero, that's noise rather than a result.
+        if (!possible || score <= 0) {
+            continue;
+        }
+
+        // `best` is a heap with the weakest match in front.
+        Match match = { this->ids[i], score };
+        if (best.size() < limit) {
+            best.push_back(match);
+            std::push_heap(best.begin(), best.end(), better);
+        } else if (better(match, best.front())) {
+            std::pop_heap(best.begin(), best.end(), better);
+            best.back() = match;
+            std::push_heap(best.begin(), best.end(), better);
+        }
+    }
+
+    std::sort(best.begin(), best.end(), better);
+    return best;
+}
+
+const char* FuzzyMatcher::Kernel() {
+    return kernels().name;
+}
@@ -0,0 +1,61 @@
+#ifndef FUZZY_MATCHER_H
+#define FUZZY_MATCHER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bitset>
+#include "database.h"
+
+namespace CipherSafe {
+
+  /*
+   * fzf style fuzzy matching over title, url and username, for when the
+   * search index (which only matches word prefixes) comes up short: the
+   * query only has to appear as a subsequence, and longer terms may miss a
+   * character or two, so "gthub" and "githbu" still find github.
+   *
+   * Build() packs every entry into one buffer, lowercased once, with a 64
+   * bit mask of the characters each entry contains. Search() drops entries
+   * whose mask can't cover the query without looking at their text, finds
+   * the characters of the rest with SSE2/AVX2 (picked at runtime, plain
+   * memchr elsewhere) and scores each match like fzf v1: the shortest
+   * window, with bonuses for word starts and runs of consecutive characters
+   * and penalties for gaps and skipped characters. once `limit` results are
+   * in, entries whose best possible score can't beat the weakest one are
+   * dropped before they are scored.
+   *
+   * case folding is ascii only, other bytes have to match exactly. urls are
+   * matched without their scheme and "www.".
+   */
+  class FuzzyMatcher {
+  public:
+    struct Match {
+      int id;
+      int score;
+    };
+
+    void Build(const std::vector<Database::Entry>& entries);
+    void Clear();
+    size_t Size() const;
+
+    /*
+     * the `limit` best matches, best first (ties in id order). terms are
+     * separated by spaces and all of them have to match.
+     */
+    std::vector<Match> Search(const std::string& query, size_t limit) const;
+
+    // the scan kernel in use: "avx2", "sse2" or "scalar".
+    static const char* Kernel();
+
+  private:
+    std::vector<char> text;          // every entry's fields, lowercased, with room for wide loads at the end
+    std::vector<uint32_t> offsets;   // where each entry starts in `text`, plus the end
+    std::vector<uint32_t> title_ends;
+    std::vector<uint64_t> masks;     // characters each entry contains
+    std::vector<int> ids;
+  };
+}
+#endif
@@ -0,0 +1,139 @@
+#include "incremental_filter.h"
+
+using namespace CipherSafe;
+
+static char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static bool is_word_char(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    return uc >= 0x80 || std::isalnum(uc);
+}
+
+static bool is_ascii(const std::string& text) {
+    for (char c : text) {
+        if (static_cast<unsigned char>(c) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool has_word_with_prefix(const std::string& text, const std::string& prefix) {
+    size_t i = 0;
+
+    while (i < text.size()) {
+        // skip to the start of the next word
+        while (i < text.size() && !is_word_char(text[i])) {
+            i++;
+        }
+
+        size_t matched = 0;
+        while (matched < prefix.size() && i + matched < text.size() &&
+               ascii_lower(text[i + matched]) == ascii_lower(prefix[matched])) {
+            matched++;
+        }
+
+        if (matched == prefix.size()) {
+            return true;
+        }
+
+        // skip the rest of this word
+        while (i < text.size() && is_word_char(text[i])) {
+            i++;
+        }
+    }
+
+    return false;
+}
+
+bool IncrementalFilter::Matches(const Database::Entry& entry, const std::vector<std::string>& terms) {
+    for (const auto& term : terms) {
+        if (!has_word_with_prefix(entry.title, term) &&
+            !has_word_with_prefix(entry.url, term) &&
+            !has_word_with_prefix(entry.category, term)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IncrementalFilter::can_refine(const std::string& query, unsigned long generation) const {
+    if (!this->has_results || this->last_query.empty() || generation != this->last_generation) {
+        return false;
+    }
+
+    // shortened or edited mid-string: the old matches are no longer a superset.
+    if (query.size() < this->last_query.size() || query.compare(0, this->last_query.size(), this->last_query) != 0) {
+        return false;
+    }
+
+    // the index folds case and diacritics of non-ascii text, which Matches() can't mirror.
+    return is_ascii(query);
+}
+
+const std::vector<int>& IncrementalFilter::Apply(Database& db, const std::string& query) {
+    const std::vector<int>* cached = Cached(query, db.Generation(), [&db](int id) { return db.CachedEntry(id); });
+    if (cached != nullptr) {
+        return *cached;
+    }
+
+    return Store(query, db.Generation(), db.Search(query));
+}
+
+const std::vector<int>* IncrementalFilter::Cached(const std::string& query, unsigned long generation, const EntryLookup& lookup) {
+    if (this->has_results && query == this->last_query && generation == this->last_generation) {
+        return &this->matches;
+    }
+
+    if (!can_refine(query, generation)) {
+        return nullptr;
+    }
+
+    std::vector<std::string> terms = Database::SearchTerms(query);
+    std::vector<int> narrowed;
+
+    for (int id : this->matches) {
+        const Database::Entry* entry = lookup(id);
+        if (entry == nullptr) {
+            continue;
+        }
+
+        // "cafe" matched "Cafés" through the index's folding, "cafes" would have to as well.
+        if (!is_ascii(entry->title) || !is_ascii(entry->url) || !is_ascii(entry->category)) {
+            return nullptr;
+        }
+
+        if (Matches(*entry, terms)) {
+            narrowed.push_back(id);
+        }
+    }
+
+    // few enough for Search() to rank them now, id order would stick otherwise.
+    if (!this->ranked && narrowed.size() <= Database::MaxRankedResults()) {
+        return nullptr;
+    }
+
+    this->matches.swap(narrowed);
+    this->last_query = query;
+
+    return &this->matches;
+}
+
+const std::vector<int>& IncrementalFilter::Store(const std::string& query, unsigned long generation, std::vector<int> matches) {
+    this->matches.swap(matches);
+    this->last_query = query;
+    this->last_generation = generation;
+    this->has_results = true;
+    this->ranked = this->matches.size() <= Database::MaxRankedResults();
+
+    return this->matches;
+}
+
+void IncrementalFilter::Reset() {
+    this->last_query.clear();
+    this->matches.clear();
+    this->has_results = false;
+}
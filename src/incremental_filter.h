@@ -0,0 +1,51 @@
+#ifndef INCREMENTAL_FILTER_H
+#define INCREMENTAL_FILTER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "database.h"
+
+namespace CipherSafe {
+
+  /*
+   * Search-as-you-type on top of Database::Search(). When the new query only
+   * extends the previous one (e.g "git" -> "gith") the previous matches are
+   * narrowed in memory instead of querying the whole vault again, so the cost
+   * of a keystroke scales with the current matches rather than the vault size.
+   *
+   * Narrowing keeps the order of the previous matches, so it is only done while
+   * that order is what Search() would return: an unranked (broad) result set
+   * is searched again once it is small enough to be ranked. Matches() only
+   * folds ascii case, so results with non-ascii text are searched again too.
+   */
+  class IncrementalFilter {
+  public:
+    // the cached entry with that id, or nullptr.
+    typedef std::function<const Database::Entry*(int id)> EntryLookup;
+
+    const std::vector<int>& Apply(Database& db, const std::string& query);
+    void Reset();
+
+    /*
+     * Apply() in two halves, for when Search() runs elsewhere (DatabaseWorker):
+     * Cached() answers from memory when it can, nullptr means Search() has to
+     * run, and Store() keeps what it returned.
+     */
+    const std::vector<int>* Cached(const std::string& query, unsigned long generation, const EntryLookup& lookup);
+    const std::vector<int>& Store(const std::string& query, unsigned long generation, std::vector<int> matches);
+
+    // true if every search term is a prefix of a word in the title, url or category.
+    static bool Matches(const Database::Entry& entry, const std::vector<std::string>& terms);
+
+  private:
+    std::string last_query;
+    unsigned long last_generation = 0;
+    bool has_results = false;
+    bool ranked = false;      // matches came back ranked, not in id order
+    std::vector<int> matches; // entry ids, best match first
+
+    bool can_refine(const std::string& query, unsigned long generation) const;
+  };
+}
+#endif
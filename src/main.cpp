@@ -6,6 +6,8 @@
 #include <SDL2/SDL_opengl.h>
 #include <iostream>
 #include <thread>
+#include <future>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -17,6 +19,12 @@
 #include "crypt.h"
 #include "settings.h"
 #include "database.h"
+#include "incremental_filter.h"
+#include "table_rows.h"
+#include "csv_importer.h"
+#include "backup.h"
+#include "database_worker.h"
+#include "fuzzy_matcher.h"
 
 // C stuff:
 #include <stdio.h>
@@ -27,6 +35,47 @@
 #include <errno.h>
 #include <pwd.h>
 
+/*
+ * milliseconds from the start of main() to each startup phase, -1 until it
+ * is reached. the vault phases count from the password being submitted
+ * instead: time spent typing it says nothing about startup.
+ */
+struct StartupTimes {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point unlockStart;
+
+    double window      = -1; // SDL, GL and ImGui are up
+    double firstFrame  = -1; // the unlock screen is on screen
+    double fonts       = -1; // the configured fonts are built (or known missing)
+    double unlock      = -1; // argon2, from the password
+    double open        = -1; // core.vault opened, after the unlock
+    double interactive = -1; // the table is up, from the password
+
+    static double MsSince(std::chrono::steady_clock::time_point from) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+    }
+
+    void Mark(double& phase) {
+        if (phase < 0) {
+            phase = MsSince(start);
+        }
+    }
+};
+
+// what the Calibrate button's task hands back.
+struct KdfCalibration {
+    CipherSafe::Crypt::KdfParams params;
+    double seconds = 0;
+};
+
+// what UnlockAndOpenVault() hands back to the main thread.
+struct VaultOpenResult {
+    bool unlocked = false;
+    std::unique_ptr<CipherSafe::Database> db; // empty if the vault couldn't be opened
+    double unlockMs = 0;
+    double openMs = 0;
+};
+
 /*
  * we need a way to globally store app
  * state(e.g if we display/hide a button or window etc...).
@@ -49,9 +98,9 @@ struct AppState {
     std::string updated_title;
     std::string updated_url;
     std::string updated_username;
-    std::string updated_password;
+    CipherSafe::SecureString updated_password;
     std::string updated_category;
-    std::string updated_notes;
+    CipherSafe::SecureString updated_notes;
 
     void clearUpdatedStrings() {
         updated_title.clear();
@@ -70,9 +119,9 @@ struct AppState {
         std::string titleBuf    = "";
         std::string urlBuf      = "";
         std::string usernameBuf = "";
-        std::string passwordBuf = "";
+        CipherSafe::SecureString passwordBuf = "";
         std::string categoryBuf = "";
-        std::string notesBuf    = "";
+        CipherSafe::SecureString notesBuf    = "";
         
         void printFormState() {
             std::cout << "===[ FormState ]===" << std::endl;
@@ -109,11 +158,74 @@ struct AppState {
     };
     WindowContext windowContext;
 
-    CipherSafe::Database::Entry *currentActiveEntry;
-    std::unique_ptr<CipherSafe::Database> db;
+    /*
+     * our own copy of the secret open in DisplaySecret, loaded from the db
+     * entry cache only when selectedEntryId changes or the db generation moves
+     * for a reason other than our own write back. currentActiveEntry points
+     * at it while it is loaded.
+     */
+    CipherSafe::Database::Entry activeEntry;
+    CipherSafe::Database::Entry *currentActiveEntry = nullptr;
+    int activeEntryId = 0;
+    unsigned long activeEntryGeneration = 0;
+
+    /*
+     * every db call runs on the worker's thread. the UI reads its mirror of
+     * the entry cache and gets results through callbacks run by Drain() at
+     * the top of each frame.
+     */
+    std::unique_ptr<CipherSafe::DatabaseWorker> db;
+    bool addPending = false;
+
+    /*
+     * edits made to the active entry in DisplaySecret are buffered here and
+     * written back as one UPDATE of only the changed columns once typing goes
+     * idle, the field loses focus, the window loses focus or the secret is closed.
+     */
+    unsigned int dirtyFields = 0;
+    std::chrono::steady_clock::time_point lastEditTime;
+
+    void markDirty(unsigned int field) {
+        dirtyFields |= field;
+        lastEditTime = std::chrono::steady_clock::now();
+    }
+
+    std::string importPath = u8"";
+
+    // rows the running import has added so far, written by the worker and copied to the console between frames.
+    std::shared_ptr<std::atomic<size_t>> importProgress;
+    size_t importShown = 0;
+
+    /*
+     * frames left to draw before the main loop goes back to sleeping in
+     * SDL_WaitEventTimeout. every event resets it, since ImGui needs a couple
+     * of frames to settle hover states and layout after input.
+     */
+    int activeFrames = 0;
 
     std::string consoleText = "Idle...";
     std::string filterQuery = u8"";
+
+    // the category picked in the sidebar, when none is the table shows every category.
+    bool categorySelected = false;
+    std::string selectedCategory = u8"";
+
+    /*
+     * rows displayed by DisplayTable, copied out of the db entry cache and
+     * only rebuilt when the cache generation or filterQuery changes.
+     */
+    CipherSafe::TableRows tableRows;
+    unsigned long tableGeneration = 0;
+    std::string tableQuery = u8"";
+    bool tableCategorySelected = false;
+    std::string tableCategory = u8"";
+    int tableSortColumn = CipherSafe::TableRows::UNSORTED;
+    bool tableSortDescending = false;
+    CipherSafe::IncrementalFilter tableFilter;
+    bool tableSearchPending = false; // a Search() for filterQuery is on the worker
+    // fuzzy matches fill in below the index's when it finds few, rebuilt lazily from the entry cache.
+    CipherSafe::FuzzyMatcher tableFuzzy;
+    unsigned long tableFuzzyGeneration = 0;
     int selectedEntryId;
     ImGuiInputTextFlags input_flags = ImGuiInputTextFlags_ReadOnly;
     std::string edit_label = "Edit";
@@ -123,6 +235,28 @@ struct AppState {
     int delete_click_step = 0;
 
     CipherSafe::Crypt crypt; 
+
+    // what was typed on the unlock screen, cleared as soon as it has been tried.
+    CipherSafe::SecureString masterPassword;
+    CipherSafe::SecureString masterPasswordConfirm;
+    std::string unlockMessage;
+
+    /*
+     * startup runs as tasks: the font atlas is built while SDL/GL come up,
+     * and the unlock + vault open runs once the password is in. the main
+     * loop polls the latter between frames (PollStartup()).
+     */
+    StartupTimes startup;
+    std::unique_ptr<ImFontAtlas> fontAtlas; // built by fontTask, shared with the ImGui context (which doesn't own it)
+    std::future<bool> fontTask; // declared after the atlas, so it is waited for before the atlas goes away
+    std::future<VaultOpenResult> vaultTask;
+    bool unlockCreating = false;
+
+    // the Calibrate button times argon2 for a few seconds, in the background as well.
+    std::future<KdfCalibration> kdfTask;
+
+    // declared after crypt so it is joined before crypt goes away.
+    std::unique_ptr<CipherSafe::Backup> backup;
 };
 
 // ====[ HELPERS ]====
@@ -138,6 +272,47 @@ static void h_print_callback_data(ImGuiInputTextCallbackData* data) {
     std::cout << "SelectionEnd: " << data->SelectionEnd << std::endl;
 }
 
+/*
+ * ImGui::InputText() for SecureStrings, the same way imgui_stdlib does it for
+ * std::string: the widget edits the string's own (locked) buffer and asks us
+ * to grow it through the resize callback.
+ */
+struct SecureInputTextData {
+    CipherSafe::SecureString* str;
+    ImGuiInputTextCallback chain_callback;
+    void* chain_user_data;
+};
+
+static int SecureInputTextCallback(ImGuiInputTextCallbackData* data) {
+    SecureInputTextData* user_data = static_cast<SecureInputTextData*>(data->UserData);
+
+    if (data->EventFlag == ImGuiInputTextFlags_CallbackResize) {
+        user_data->str->reserve(data->BufSize);
+        user_data->str->resize(data->BufTextLen);
+        data->Buf = user_data->str->data();
+        return 0;
+    }
+
+    if (user_data->chain_callback) {
+        data->UserData = user_data->chain_user_data;
+        return user_data->chain_callback(data);
+    }
+
+    return 0;
+}
+
+static bool InputSecret(const char* label, CipherSafe::SecureString* str, ImGuiInputTextFlags flags = 0, ImGuiInputTextCallback callback = nullptr, void* user_data = nullptr) {
+    SecureInputTextData data = { str, callback, user_data };
+    char* buf = str->data();
+    return ImGui::InputText(label, buf, str->capacity() + 1, flags | ImGuiInputTextFlags_CallbackResize, SecureInputTextCallback, &data);
+}
+
+static bool InputSecretMultiline(const char* label, CipherSafe::SecureString* str, const ImVec2& size, ImGuiInputTextFlags flags = 0, ImGuiInputTextCallback callback = nullptr, void* user_data = nullptr) {
+    SecureInputTextData data = { str, callback, user_data };
+    char* buf = str->data();
+    return ImGui::InputTextMultiline(label, buf, str->capacity() + 1, size, flags | ImGuiInputTextFlags_CallbackResize, SecureInputTextCallback, &data);
+}
+
 // ====[FUNCTION DECLARATIONS]====
 static void MainWindowTearDown(std::unique_ptr<AppState>& app_state);
 static void DisplayAddForm(std::unique_ptr<AppState>& app_state);
@@ -145,12 +320,12 @@ static void DisplayTable(std::unique_ptr<AppState>& app_state);
 static void DisplayConsole(std::unique_ptr<AppState>& app_state);
 static void DisplaySecret(std::unique_ptr<AppState>& app_state);
 static void DisplaySettings(std::unique_ptr<AppState>& app_state);
+static void DisplayUnlock(std::unique_ptr<AppState>& app_state);
 static void InitSDL(std::unique_ptr<AppState>& app_state);
 static void ShowMainWindow(std::unique_ptr<AppState>& app_state);
 static bool createAppDir(const std::string& dirPath);
 static std::string getUserHomeDir();
 static bool InitApp();
-static std::string randomString(size_t length);
 static void openURL(const std::string& url);
 
 // ====[FUNCTION DEFINITIONS]====
@@ -228,16 +403,6 @@ static bool createAppDir(const std::string& dirPath) {
     return true;
 }
 
-static bool stringContainsSubstringIgnoreCase(const std::string& str, const std::string& substr) {
-    std::string strLower = str;
-    std::string substrLower = substr;
-
-    std::transform(strLower.begin(), strLower.end(), strLower.begin(), [](unsigned char c){ return std::tolower(c); });
-    std::transform(substrLower.begin(), substrLower.end(), substrLower.begin(), [](unsigned char c){ return std::tolower(c); });
-
-    return strLower.find(substrLower) != std::string::npos;
-}
-
 static bool canLoadFont(const std::string& fontPath) {
     if (fontPath.empty()) {
         return false;
@@ -252,51 +417,67 @@ static bool canLoadFont(const std::string& fontPath) {
     }
 }
 
-static void loadFontsTask(ImGuiIO* io, std::unique_ptr<AppState>& app_state) {
-    (void)*io;
+/*
+ * builds the configured fonts into `atlas`, which nothing else touches until
+ * this returns. false if none of them exist, the default font stays then.
+ */
+static bool loadFontsTask(ImFontAtlas* atlas, const CipherSafe::Settings& settings) {
+    bool loaded = false;
 
     // Handle font loading:
-    if (canLoadFont(app_state->settings->font_path)) {
+    if (canLoadFont(settings.font_path)) {
         std::cout << "loading main app font..." << std::endl;
-        io->Fonts->AddFontFromFileTTF(app_state->settings->font_path.c_str(), app_state->settings->font_size, nullptr, io->Fonts->GetGlyphRangesDefault());
+        atlas->AddFontFromFileTTF(settings.font_path.c_str(), settings.font_size, nullptr, atlas->GetGlyphRangesDefault());
+        loaded = true;
     } else {
         std::cout << "no main font found default font..." << std::endl;
-        io->Fonts->AddFontDefault();
+        atlas->AddFontDefault();
     }
 
     ImFontConfig fontConfig;
     fontConfig.MergeMode = true;
 
     // load non-latin fonts here:
-    if (canLoadFont(app_state->settings->japanese_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->japanese_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesJapanese());
+    if (canLoadFont(settings.japanese_font_path)) {
+        atlas->AddFontFromFileTTF(settings.japanese_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesJapanese());
+        loaded = true;
+    }
+
+    if (canLoadFont(settings.korean_font_path)) {
+        atlas->AddFontFromFileTTF(settings.korean_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesKorean());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->korean_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->korean_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesKorean());
+    if (canLoadFont(settings.chinese_font_path)) {
+        atlas->AddFontFromFileTTF(settings.chinese_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesChineseFull());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->chinese_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->chinese_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesChineseFull());
+    if (canLoadFont(settings.thai_font_path)) {
+        atlas->AddFontFromFileTTF(settings.thai_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesThai());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->thai_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->thai_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesThai());
+    if (canLoadFont(settings.viet_font_path)) {
+        atlas->AddFontFromFileTTF(settings.viet_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesVietnamese());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->viet_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->viet_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesVietnamese());
+    if (canLoadFont(settings.cyrillic_font_path)) {
+        atlas->AddFontFromFileTTF(settings.cyrillic_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesCyrillic());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->cyrillic_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->cyrillic_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesCyrillic());
+    if (canLoadFont(settings.greek_font_path)) {
+        atlas->AddFontFromFileTTF(settings.greek_font_path.c_str(), settings.font_size, &fontConfig, atlas->GetGlyphRangesGreek());
+        loaded = true;
     }
 
-    if (canLoadFont(app_state->settings->greek_font_path)) {
-        io->Fonts->AddFontFromFileTTF(app_state->settings->greek_font_path.c_str(), app_state->settings->font_size, &fontConfig, io->Fonts->GetGlyphRangesGreek());
+    if (loaded) {
+        atlas->Build();
     }
 
-    io->Fonts->Build();
+    return loaded;
 }
 
 static void InitSDL(std::unique_ptr<AppState>& app_state) {
@@ -327,16 +508,18 @@ static void InitSDL(std::unique_ptr<AppState>& app_state) {
     SDL_GL_MakeCurrent(window, gl_context);
     SDL_GL_SetSwapInterval(1); // Enable vsync
 
+    // ImGui allocates through the current context (and counts there), the atlas has to be built before there is one.
+    if (app_state->fontTask.valid() && !app_state->fontTask.get()) {
+        app_state->fontAtlas.reset(); // none of the fonts exist, the context makes its own with the default one.
+    }
+    app_state->startup.Mark(app_state->startup.fonts);
+
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
+    ImGui::CreateContext(app_state->fontAtlas.get());
     
     ImGuiIO& io = ImGui::GetIO(); (void)io;
 
-    auto start = std::chrono::high_resolution_clock::now();
-    std::thread load_fonts(loadFontsTask, &io, std::ref(app_state));
-    //loadFontsTask(&io, std::ref(app_state));
-
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
     app_state->windowContext.imgui_io = &io;
@@ -365,17 +548,162 @@ static void InitSDL(std::unique_ptr<AppState>& app_state) {
     app_state->windowContext.window = window;
 }
 
-static void DisplayTable(std::unique_ptr<AppState>& app_state) {
-    std::vector<std::unique_ptr<CipherSafe::Database::Entry>> dbEntries;
+static void SearchTableRows(std::unique_ptr<AppState>& app_state) {
+    if (app_state->tableSearchPending) {
+        return;
+    }
 
-    if (app_state->filterQuery.empty()) {
-        dbEntries = app_state->db->GetAll();
+    AppState* state = app_state.get();
+    std::string query = app_state->filterQuery;
+    unsigned long generation = app_state->db->Generation();
+
+    app_state->tableSearchPending = true;
+    app_state->db->Search(query, [state, query, generation](const CipherSafe::DatabaseWorker::Result& result) {
+        // stored even if the query moved on meanwhile, it may still be refined from.
+        state->tableFilter.Store(query, generation, result.ids);
+        state->tableSearchPending = false;
+    });
+}
+
+// how many fuzzy matches a search adds at most, and only while the index found fewer than that.
+static const size_t FUZZY_RESULTS = 100;
+
+/*
+ * appends the best fuzzy matches for filterQuery that `matches` (the
+ * index's) doesn't have yet, so a typo or a skipped letter still finds
+ * the entry. scoring runs right here on the UI thread, it fits in a frame.
+ */
+static void AddFuzzyRows(std::unique_ptr<AppState>& app_state, const std::vector<int>& matches, const std::vector<int>* in_category) {
+    const CipherSafe::DatabaseWorker& db = *app_state->db;
+
+    if (app_state->tableFuzzyGeneration != db.Generation()) {
+        app_state->tableFuzzy.Build(db.Entries());
+        app_state->tableFuzzyGeneration = db.Generation();
     }
-    else {
-        dbEntries = app_state->db->Filter(app_state->filterQuery);
+
+    for (const auto& match : app_state->tableFuzzy.Search(app_state->filterQuery, FUZZY_RESULTS)) {
+        if (std::find(matches.begin(), matches.end(), match.id) != matches.end()) {
+            continue;
+        }
+        if (in_category != nullptr && !std::binary_search(in_category->begin(), in_category->end(), match.id)) {
+            continue;
+        }
+
+        const CipherSafe::Database::Entry* entry = db.CachedEntry(match.id);
+        if (entry != nullptr) {
+            app_state->tableRows.Add(*entry);
+        }
+    }
+}
+
+static void RefreshTableRows(std::unique_ptr<AppState>& app_state) {
+    unsigned long generation = app_state->db->Generation();
+
+    if (generation == app_state->tableGeneration && app_state->filterQuery == app_state->tableQuery &&
+        app_state->categorySelected == app_state->tableCategorySelected && app_state->selectedCategory == app_state->tableCategory) {
+        return;
+    }
+
+    const CipherSafe::DatabaseWorker& db = *app_state->db;
+    const std::vector<int>* matches = nullptr;
+    const std::vector<int>* in_category = nullptr; // in id order
+
+    if (app_state->categorySelected) {
+        in_category = db.Categories().Ids(app_state->selectedCategory);
+
+        // its last entry was deleted or moved out.
+        if (in_category == nullptr) {
+            app_state->categorySelected = false;
+            app_state->selectedCategory.clear();
+        }
+    }
+
+    if (!app_state->filterQuery.empty()) {
+        matches = app_state->tableFilter.Cached(app_state->filterQuery, generation, [&db](int id) { return db.CachedEntry(id); });
+
+        // the index has to be asked: the old rows stay up until the worker answers.
+        if (matches == nullptr) {
+            SearchTableRows(app_state);
+            return;
+        }
     }
 
-    int entriesSize = dbEntries.size();
+    app_state->tableRows.Clear();
+
+    if (matches == nullptr && in_category == nullptr) {
+        app_state->tableRows.Reserve(db.Entries().size());
+
+        for (const auto& entry : db.Entries()) {
+            app_state->tableRows.Add(entry);
+        }
+    } else if (matches == nullptr) {
+        // straight out of the category index, no scan of the vault.
+        app_state->tableRows.Reserve(in_category->size());
+
+        for (int id : *in_category) {
+            const CipherSafe::Database::Entry* entry = db.CachedEntry(id);
+
+            if (entry != nullptr) {
+                app_state->tableRows.Add(*entry);
+            }
+        }
+    } else {
+        // search results come back ranked, best match first.
+        app_state->tableRows.Reserve(matches->size());
+
+        for (int id : *matches) {
+            if (in_category != nullptr && !std::binary_search(in_category->begin(), in_category->end(), id)) {
+                continue;
+            }
+
+            const CipherSafe::Database::Entry* entry = db.CachedEntry(id);
+
+            if (entry != nullptr) {
+                app_state->tableRows.Add(*entry);
+            }
+        }
+
+        if (matches->size() < FUZZY_RESULTS) {
+            AddFuzzyRows(app_state, *matches, in_category);
+        }
+    }
+
+    app_state->tableGeneration = generation;
+    app_state->tableQuery = app_state->filterQuery;
+    app_state->tableCategorySelected = app_state->categorySelected;
+    app_state->tableCategory = app_state->selectedCategory;
+    app_state->tableRows.Sort(app_state->tableSortColumn, app_state->tableSortDescending);
+}
+
+// every category with its entry count, clicking one narrows the table to it.
+static void DisplayCategories(std::unique_ptr<AppState>& app_state) {
+    const CipherSafe::DatabaseWorker& db = *app_state->db;
+    ImVec2 size(ImGui::GetFontSize() * 12.0f, 0.0f);
+
+    ImGui::Spacing();
+    std::string all = "All (" + std::to_string(db.Entries().size()) + ")";
+    if (ImGui::Selectable(all.c_str(), !app_state->categorySelected, 0, size)) {
+        app_state->categorySelected = false;
+        app_state->selectedCategory.clear();
+    }
+
+    for (const auto& category : db.Categories().Categories()) {
+        bool selected = app_state->categorySelected && app_state->selectedCategory == category.first;
+        std::string label = (category.first.empty() ? "(none)" : category.first) +
+                            " (" + std::to_string(category.second.size()) + ")##" + category.first;
+
+        if (ImGui::Selectable(label.c_str(), selected, 0, size)) {
+            app_state->categorySelected = true;
+            app_state->selectedCategory = category.first;
+        }
+    }
+}
+
+static void DisplayTable(std::unique_ptr<AppState>& app_state) {
+    RefreshTableRows(app_state);
+
+    const CipherSafe::TableRows& rows = app_state->tableRows;
+    int entriesSize = rows.Size();
     bool selected = false;
 
     ImGui::Spacing();
@@ -388,35 +716,56 @@ static void DisplayTable(std::unique_ptr<AppState>& app_state) {
         ImGui::Spacing();
         ImGui::Spacing();
 
-        if (ImGui::BeginTable("##secrets_list", 4, ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders | ImGuiTableFlags_Sortable)) {
-            ImGui::TableSetupColumn("ID", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_WidthFixed);
-            ImGui::TableSetupColumn("TITLE");
-            ImGui::TableSetupColumn("URL/SERVICE/APP");
-            ImGui::TableSetupColumn("CATEGORY");
+        // tristate: a third click goes back to id order, or best match first while searching.
+        if (ImGui::BeginTable("##secrets_list", 4, ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortTristate)) {
+            ImGui::TableSetupColumn("ID", ImGuiTableColumnFlags_WidthFixed, 0.0f, CipherSafe::TableRows::COLUMN_ID);
+            ImGui::TableSetupColumn("TITLE", 0, 0.0f, CipherSafe::TableRows::COLUMN_TITLE);
+            ImGui::TableSetupColumn("URL/SERVICE/APP", 0, 0.0f, CipherSafe::TableRows::COLUMN_URL);
+            ImGui::TableSetupColumn("CATEGORY", 0, 0.0f, CipherSafe::TableRows::COLUMN_CATEGORY);
             ImGui::TableHeadersRow();
 
-            //ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs();
+            // the specs are only dirty after a header click, and the permutations are cached per column.
+            ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs();
+            if (sort_specs != nullptr && sort_specs->SpecsDirty) {
+                if (sort_specs->SpecsCount > 0) {
+                    app_state->tableSortColumn = sort_specs->Specs[0].ColumnUserID;
+                    app_state->tableSortDescending = sort_specs->Specs[0].SortDirection == ImGuiSortDirection_Descending;
+                } else {
+                    app_state->tableSortColumn = CipherSafe::TableRows::UNSORTED;
+                    app_state->tableSortDescending = false;
+                }
 
-            for(auto& entry: dbEntries) {
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
+                app_state->tableRows.Sort(app_state->tableSortColumn, app_state->tableSortDescending);
+                sort_specs->SpecsDirty = false;
+            }
 
-                if (ImGui::Selectable(std::to_string(entry->id).c_str(), selected, ImGuiSelectableFlags_SpanAllColumns)) {
-                    std::cout << "selected: " << "id: " << std::to_string(entry->id) << std::endl;
-                    app_state->show_secret = true;
-                    app_state->selectedEntryId = entry->id;
-                }
+            // only the rows scrolled into view are submitted.
+            ImGuiListClipper clipper;
+            clipper.Begin(entriesSize);
+
+            while (clipper.Step()) {
+                for (int position = clipper.DisplayStart; position < clipper.DisplayEnd; position++) {
+                    size_t row = rows.Row(position);
+
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
 
-                ImGui::TableNextColumn();
+                    if (ImGui::Selectable(rows.IdLabel(row), selected, ImGuiSelectableFlags_SpanAllColumns)) {
+                        std::cout << "selected: " << "id: " << rows.IdLabel(row) << std::endl;
+                        app_state->show_secret = true;
+                        app_state->selectedEntryId = rows.Id(row);
+                    }
 
-                ImGui::Text(entry->title.c_str());
-                ImGui::TableNextColumn();
+                    ImGui::TableNextColumn();
 
-                ImGui::Text(entry->url.c_str());
-                ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(rows.Title(row));
+                    ImGui::TableNextColumn();
 
-                ImGui::Text(entry->category.c_str());
-                ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(rows.Url(row));
+                    ImGui::TableNextColumn();
+
+                    ImGui::TextUnformatted(rows.Category(row));
+                }
             }
 
             ImGui::EndTable();
@@ -425,7 +774,10 @@ static void DisplayTable(std::unique_ptr<AppState>& app_state) {
     else if (!app_state->filterQuery.empty() && entriesSize <= 0) {
         ImGui::Spacing();
         std::string noResultsMsg = "No secrets found searching with: " + app_state->filterQuery;
-        ImGui::Text(noResultsMsg.c_str());
+        if (app_state->categorySelected) {
+            noResultsMsg += " in " + (app_state->selectedCategory.empty() ? std::string("(none)") : app_state->selectedCategory);
+        }
+        ImGui::TextUnformatted(noResultsMsg.c_str());
     }
     else {
         ImGui::Spacing();
@@ -465,21 +817,28 @@ static void ShowMainWindow(std::unique_ptr<AppState>& app_state) {
 
     ImGui::SeparatorText("Secrets List");
 
+    ImGui::BeginGroup();
+    DisplayCategories(app_state);
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    ImGui::BeginGroup();
     DisplayTable(app_state);
+    ImGui::EndGroup();
     DisplayConsole(app_state);
 
     ImGui::End();
 }
 
 static void DisplayAddForm(std::unique_ptr<AppState>& app_state) {
-    bool didSave = false;
-
     if (app_state->show_add_form) {
         ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
         ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
         ImGui::Begin("Add New Secret", &app_state->show_add_form, ImGuiWindowFlags_NoDecoration);
         ImGui::SeparatorText("Add New Secret");
 
+        ImGui::BeginDisabled(app_state->addPending);
         if (ImGui::Button("Save")) {
             if(app_state->formState.urlBuf.empty()) {
                 app_state->consoleText = "the url/app/service text field cannot be empty.";
@@ -492,17 +851,25 @@ static void DisplayAddForm(std::unique_ptr<AppState>& app_state) {
                 entry->category = app_state->formState.categoryBuf;
                 entry->notes    = app_state->formState.notesBuf;
 
-                if (app_state->db->Add(std::move(entry))) {
-                    didSave = true;
-                    app_state->consoleText = "successfully saved new secret to database...";
-                }
-            }
-
-            if(didSave) {
-                app_state->show_add_form = false;
-                app_state->resetFormState();
+                // the form stays open (and the button disabled) until the worker has saved it.
+                AppState* state = app_state.get();
+                app_state->addPending = true;
+                app_state->consoleText = "saving new secret...";
+
+                app_state->db->Add(std::move(entry), [state](const CipherSafe::DatabaseWorker::Result& result) {
+                    state->addPending = false;
+
+                    if (result.ok) {
+                        state->consoleText = "successfully saved new secret to database...";
+                        state->show_add_form = false;
+                        state->resetFormState();
+                    } else {
+                        state->consoleText = "failed to save new secret...";
+                    }
+                });
             }
         }
+        ImGui::EndDisabled();
 
         ImGui::SameLine();
 
@@ -536,7 +903,7 @@ static void DisplayAddForm(std::unique_ptr<AppState>& app_state) {
         ImGui::Spacing();
         ImGui::PushItemWidth(-1);
         ImGui::Text("Password");
-        ImGui::InputText("##password", &app_state->formState.passwordBuf);
+        InputSecret("##password", &app_state->formState.passwordBuf);
         if (ImGui::Button("Generate Password")) {
             int password_length = app_state->settings->password_length;
             if (password_length <= 0) {
@@ -546,8 +913,7 @@ static void DisplayAddForm(std::unique_ptr<AppState>& app_state) {
             if (password_length > 200) {
                 password_length = 200; // the max chars that we generate for a password.
             }
-            std::string generatedRandomString = randomString(password_length);
-            app_state->formState.passwordBuf = generatedRandomString;
+            app_state->formState.passwordBuf = CipherSafe::Crypt::random_string(password_length);
             app_state->consoleText = "new password successfully generated...";
         }
         ImGui::Spacing();
@@ -562,7 +928,7 @@ static void DisplayAddForm(std::unique_ptr<AppState>& app_state) {
         ImGui::Spacing();
         ImGui::PushItemWidth(-1);
         ImGui::Text("Notes:");
-        ImGui::InputTextMultiline("##notes", &app_state->formState.notesBuf, ImVec2(450, 85), ImGuiInputTextFlags_AllowTabInput);
+        InputSecretMultiline("##notes", &app_state->formState.notesBuf, ImVec2(450, 85), ImGuiInputTextFlags_AllowTabInput);
         ImGui::PopItemWidth();
 
         DisplayConsole(app_state);
@@ -577,14 +943,7 @@ static int TitleInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
 
         if (data->Buf) { 
             app_state->currentActiveEntry->title = std::string(data->Buf);
-
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
-            }
+            app_state->markDirty(CipherSafe::Database::FIELD_TITLE);
         }
     }
 
@@ -597,14 +956,7 @@ static int URLInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
 
         if (data->Buf) { 
             app_state->currentActiveEntry->url = std::string(data->Buf);
-
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
-            }
+            app_state->markDirty(CipherSafe::Database::FIELD_URL);
         }
     }
 
@@ -617,14 +969,7 @@ static int UsernameInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
 
         if (data->Buf) { 
             app_state->currentActiveEntry->username = std::string(data->Buf);
-
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
-            }
+            app_state->markDirty(CipherSafe::Database::FIELD_USERNAME);
         }
     }
 
@@ -636,15 +981,8 @@ static int PasswordInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
         AppState *app_state = static_cast<AppState*>(data->UserData);
 
         if (data->Buf) { 
-            app_state->currentActiveEntry->password = std::string(data->Buf);
-
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
-            }
+            app_state->currentActiveEntry->password = data->Buf;
+            app_state->markDirty(CipherSafe::Database::FIELD_PASSWORD);
         }
     }
 
@@ -657,14 +995,7 @@ static int CategoryInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
 
         if (data->Buf) { 
             app_state->currentActiveEntry->category = std::string(data->Buf);
-
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
-            }
+            app_state->markDirty(CipherSafe::Database::FIELD_CATEGORY);
         }
     }
 
@@ -676,19 +1007,462 @@ static int NotesInputTextUpdateCallback(ImGuiInputTextCallbackData* data) {
         AppState *app_state = static_cast<AppState*>(data->UserData);
 
         if (data->Buf) { 
-            app_state->currentActiveEntry->notes = std::string(data->Buf);
+            app_state->currentActiveEntry->notes = data->Buf;
+            app_state->markDirty(CipherSafe::Database::FIELD_NOTES);
+        }
+    }
 
-            if (app_state->db->Update( app_state->currentActiveEntry )) {
-                app_state->consoleText = "successfully updated secret.";
-                return 0;
-            } else {
-                app_state->consoleText = "failed to update secret.";
-                return 1;
+    return 0;
+}
+
+static void FlushPendingEdits(std::unique_ptr<AppState>& app_state) {
+    if (app_state->dirtyFields == 0 || app_state->currentActiveEntry == nullptr) {
+        return;
+    }
+
+    AppState* state = app_state.get();
+    int id = app_state->currentActiveEntry->id;
+    unsigned int flushed = app_state->dirtyFields;
+
+    // cleared now so the idle flush doesn't post the same edit again while this one is in flight.
+    app_state->dirtyFields = 0;
+
+    app_state->db->UpdateFields(*app_state->currentActiveEntry, flushed, [state, id, flushed](const CipherSafe::DatabaseWorker::Result& result) {
+        if (result.ok) {
+            // activeEntry already holds what was just written, no need to reload it.
+            if (state->activeEntryId == id) {
+                state->activeEntryGeneration = state->db->Generation();
             }
+            state->consoleText = "successfully updated secret.";
+        } else {
+            // still unsaved, the next idle flush tries again (unless the secret was closed or deleted meanwhile).
+            if (state->activeEntryId == id && state->currentActiveEntry != nullptr) {
+                state->markDirty(flushed);
+            }
+            state->consoleText = "failed to update secret.";
         }
+    });
+}
+
+static const auto EDIT_IDLE_INTERVAL = std::chrono::milliseconds(750);
+
+static void FlushIdleEdits(std::unique_ptr<AppState>& app_state) {
+    if (app_state->dirtyFields != 0 && std::chrono::steady_clock::now() - app_state->lastEditTime >= EDIT_IDLE_INTERVAL) {
+        FlushPendingEdits(app_state);
     }
+}
 
-    return 0;
+// gets the main loop out of SDL_WaitEvent from another thread. SDL_PushEvent is thread safe.
+static void WakeMainLoop() {
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+}
+
+/*
+ * how long the main loop may sleep waiting for input, in ms (-1 = until the
+ * next event). anything that changes the screen without an event has to
+ * show up here, or it will only be drawn after the next mouse move.
+ */
+static int IdleTimeout(std::unique_ptr<AppState>& app_state) {
+    int timeout = -1;
+
+    auto wake_in = [&timeout](int ms) {
+        ms = std::max(ms, 1);
+        timeout = timeout < 0 ? ms : std::min(timeout, ms);
+    };
+
+    // pending edits get written once typing goes idle.
+    if (app_state->dirtyFields != 0) {
+        auto remaining = EDIT_IDLE_INTERVAL - (std::chrono::steady_clock::now() - app_state->lastEditTime);
+        wake_in(std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count());
+    }
+
+    // background tasks are polled between frames, and their spinners turn.
+    if (app_state->vaultTask.valid() || app_state->kdfTask.valid()) {
+        wake_in(100);
+    }
+
+    // keep the text cursor blinking.
+    if (app_state->windowContext.imgui_io->WantTextInput) {
+        wake_in(500);
+    }
+
+    return timeout;
+}
+
+/*
+ * imports the CSV at importPath in one batch: either every row makes it in
+ * or none do.
+ */
+static void ImportCsv(std::unique_ptr<AppState>& app_state) {
+    std::ifstream file(app_state->importPath, std::ios::binary);
+    if (!file.is_open()) {
+        app_state->consoleText = "couldn't open " + app_state->importPath + "...";
+        return;
+    }
+
+    // the file is read on the worker, so everything it uses lives until the batch is done.
+    struct Import {
+        std::ifstream file;
+        std::unique_ptr<CipherSafe::CsvImporter> importer;
+        size_t imported = 0;
+    };
+
+    std::shared_ptr<Import> import(new Import());
+    import->file.swap(file);
+    import->importer.reset(new CipherSafe::CsvImporter(import->file));
+
+    AppState* state = app_state.get();
+    app_state->consoleText = "importing " + app_state->importPath + "...";
+
+    std::shared_ptr<std::atomic<size_t>> progress(new std::atomic<size_t>(0));
+    app_state->importProgress = progress;
+    app_state->importShown = 0;
+
+    app_state->db->AddBatch(import->importer->Source(), [import, progress](size_t added) {
+        import->imported = added;
+        progress->store(added);
+        WakeMainLoop();
+        return true;
+    }, [state, import](const CipherSafe::DatabaseWorker::Result& result) {
+        const CipherSafe::CsvImporter& importer = *import->importer;
+        state->importProgress.reset();
+
+        if (result.ok) {
+            state->consoleText = "successfully imported " + std::to_string(import->imported) + " entries...";
+        } else if (!importer.Error().empty()) {
+            state->consoleText = "import failed on line " + std::to_string(importer.Line()) + ": " + importer.Error() + "...";
+        } else {
+            state->consoleText = "import failed, nothing was imported...";
+        }
+    });
+}
+
+// true if the console shows a new count for the running import.
+static bool PollImportProgress(std::unique_ptr<AppState>& app_state) {
+    if (!app_state->importProgress) {
+        return false;
+    }
+
+    size_t imported = app_state->importProgress->load();
+    if (imported == app_state->importShown) {
+        return false;
+    }
+
+    app_state->importShown = imported;
+    app_state->consoleText = "importing... " + std::to_string(imported) + " entries so far";
+    return true;
+}
+
+static void StartBackup(std::unique_ptr<AppState>& app_state) {
+    if (app_state->settings->backup_dir.empty()) {
+        app_state->consoleText = "set a backup directory first...";
+        return;
+    }
+
+    if (app_state->backup->Start(app_state->crypt.vault_path(), app_state->settings->backup_dir, app_state->settings->backup_retention)) {
+        app_state->consoleText = "backing up the vault...";
+    } else {
+        app_state->consoleText = "a backup is already running...";
+    }
+}
+
+static CipherSafe::Crypt::KdfParams KdfParamsFromSettings(const CipherSafe::Settings& settings) {
+    if (settings.kdf_profile == "calibrated" && settings.kdf_opslimit > 0 && settings.kdf_memlimit > 0) {
+        CipherSafe::Crypt::KdfParams params;
+        params.opslimit = settings.kdf_opslimit;
+        params.memlimit = static_cast<size_t>(settings.kdf_memlimit);
+        return params;
+    }
+
+    return CipherSafe::Crypt::kdf_profile(settings.kdf_profile);
+}
+
+static CipherSafe::Database::StorageParams StorageParamsFromSettings(const CipherSafe::Settings& settings) {
+    CipherSafe::Database::StorageParams storage = CipherSafe::Database::StorageProfile(settings.storage_profile);
+
+    if (!settings.storage_journal_mode.empty()) storage.journal_mode = settings.storage_journal_mode;
+    if (!settings.storage_synchronous.empty())  storage.synchronous  = settings.storage_synchronous;
+    if (!settings.storage_temp_store.empty())   storage.temp_store   = settings.storage_temp_store;
+    if (settings.storage_cache_size != 0)       storage.cache_size   = settings.storage_cache_size;
+    if (settings.storage_mmap_size >= 0)        storage.mmap_size    = settings.storage_mmap_size;
+    if (settings.storage_page_size > 0)         storage.page_size    = settings.storage_page_size;
+
+    return storage;
+}
+
+static std::string DescribeKdfParams(const CipherSafe::Crypt::KdfParams& params) {
+    return std::to_string(params.opslimit) + " passes over " + std::to_string(params.memlimit / (1024 * 1024)) + " MiB";
+}
+
+// a few derivations, around twice the target time, so it runs on a worker. PollKdfCalibration() picks it up.
+static void CalibrateKdf(std::unique_ptr<AppState>& app_state) {
+    if (app_state->kdfTask.valid()) {
+        return;
+    }
+
+    double target = app_state->settings->kdf_target_ms / 1000.0;
+    app_state->consoleText = "calibrating the master password...";
+
+    app_state->kdfTask = std::async(std::launch::async, [target]() {
+        KdfCalibration calibration;
+        calibration.params = CipherSafe::Crypt::calibrate_kdf(target, &calibration.seconds);
+        return calibration;
+    });
+}
+
+template <typename T>
+static bool TaskReady(const std::future<T>& task) {
+    return task.valid() && task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// true once a finished calibration has been applied to the settings.
+static bool PollKdfCalibration(std::unique_ptr<AppState>& app_state) {
+    if (!TaskReady(app_state->kdfTask)) {
+        return false;
+    }
+
+    KdfCalibration calibration = app_state->kdfTask.get();
+
+    app_state->settings->kdf_profile = "calibrated";
+    app_state->settings->kdf_opslimit = calibration.params.opslimit;
+    app_state->settings->kdf_memlimit = calibration.params.memlimit;
+
+    app_state->consoleText = "calibrated the master password to " + DescribeKdfParams(calibration.params) + ", " +
+        std::to_string(static_cast<int>(calibration.seconds * 1000)) + "ms per unlock, save to use it from the next unlock...";
+    return true;
+}
+
+// the database and the WAL files next to it.
+static void RemoveVaultFiles(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+/*
+ * opens core.vault once the key is unlocked, importing the vault of an older
+ * version first if there is one. empty if the app can't go on.
+ */
+static std::unique_ptr<CipherSafe::Database> OpenVault(CipherSafe::Crypt& crypt, const CipherSafe::Database::StorageParams& storage) {
+    std::unique_ptr<CipherSafe::Database> db;
+
+    /*
+     * vaults from older versions get imported into core.vault once. the import
+     * is only done once the old vault is retired: a core.vault next to it is
+     * left from an import that didn't finish, and is started over.
+     */
+    std::vector<unsigned char> legacy_image;
+    bool migrate = crypt.legacy_vault_exists();
+    if (migrate && !crypt.decrypt_to_memory(legacy_image)) {
+        std::cerr << "failed to decrypt the vault, refusing to start." << std::endl;
+        return db;
+    }
+
+    if (migrate && std::ifstream(crypt.vault_path()).good()) {
+        std::cerr << "the last import of the existing vault didn't finish, starting it over." << std::endl;
+        RemoveVaultFiles(crypt.vault_path());
+    }
+
+    unsigned char page_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+    crypt.derive_page_key(page_key);
+
+    try {
+        db.reset(new CipherSafe::Database(crypt.vault_path(), page_key, storage));
+    } catch (const std::runtime_error& e) {
+        std::cerr << "failed to open the vault: " << e.what() << std::endl;
+    }
+    sodium_memzero(page_key, sizeof(page_key));
+
+    if (db && migrate) {
+        bool imported = db->Import(legacy_image);
+
+        // the old vault stays the real one until it is retired, so a failure here leaves it in charge.
+        if (!imported || !crypt.retire_legacy_vault()) {
+            std::cerr << "failed to import the existing vault, refusing to start." << std::endl;
+            db->Close();
+            db.reset();
+            RemoveVaultFiles(crypt.vault_path());
+        }
+    }
+
+    sodium_memzero(legacy_image.data(), legacy_image.size());
+    return db;
+}
+
+/*
+ * the vault side of startup, run on a worker once the master password is in
+ * so the window keeps drawing (and spinning) through argon2 and the open.
+ */
+static VaultOpenResult UnlockAndOpenVault(CipherSafe::Crypt& crypt, CipherSafe::SecureString password, CipherSafe::Crypt::KdfParams params,
+                                          CipherSafe::Database::StorageParams storage, bool creating) {
+    VaultOpenResult result;
+
+    result.unlocked = creating ? crypt.create_master_password(password, params) : crypt.unlock(password, params);
+    result.unlockMs = crypt.unlock_seconds() * 1000;
+    password.clear();
+
+    if (!result.unlocked) {
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    result.db = OpenVault(crypt, storage);
+    result.openMs = StartupTimes::MsSince(start);
+
+    return result;
+}
+
+static void UnlockVault(std::unique_ptr<AppState>& app_state) {
+    CipherSafe::Crypt::KdfParams params = KdfParamsFromSettings(*app_state->settings);
+    bool creating = !app_state->crypt.has_master_password();
+
+    if (app_state->masterPassword.empty()) {
+        app_state->unlockMessage = "enter the master password...";
+        return;
+    }
+
+    if (creating && app_state->masterPassword != app_state->masterPasswordConfirm) {
+        app_state->unlockMessage = "the passwords don't match...";
+        app_state->masterPasswordConfirm.clear();
+        return;
+    }
+
+    app_state->unlockCreating = creating;
+    app_state->unlockMessage.clear();
+    app_state->startup.unlockStart = std::chrono::steady_clock::now();
+    app_state->vaultTask = std::async(std::launch::async, UnlockAndOpenVault,
+        std::ref(app_state->crypt), app_state->masterPassword, params, StorageParamsFromSettings(*app_state->settings), creating);
+
+    app_state->masterPassword.clear();
+    app_state->masterPasswordConfirm.clear();
+}
+
+/*
+ * rasterizing the configured fonts needs no window, it runs alongside SDL/GL
+ * init. InitSDL() waits for it before creating the ImGui context.
+ */
+static void StartFontLoad(std::unique_ptr<AppState>& app_state) {
+    app_state->fontAtlas.reset(new ImFontAtlas());
+
+    ImFontAtlas* atlas = app_state->fontAtlas.get();
+    CipherSafe::Settings settings = *app_state->settings; // the task gets its own copy
+
+    app_state->fontTask = std::async(std::launch::async, [atlas, settings]() {
+        return loadFontsTask(atlas, settings);
+    });
+}
+
+static void ReportStartup(std::unique_ptr<AppState>& app_state) {
+    const StartupTimes& times = app_state->startup;
+
+    std::cout << "startup: window " << times.window << "ms, first frame " << times.firstFrame << "ms, fonts " << times.fonts << "ms" << std::endl;
+    std::cout << "unlock: key " << times.unlock << "ms, vault open " << times.open << "ms, interactive " << times.interactive << "ms after the password was submitted" << std::endl;
+}
+
+/*
+ * picks up the unlock + vault open once it has finished. runs between
+ * frames, true if something changed on screen.
+ */
+static bool PollStartup(std::unique_ptr<AppState>& app_state) {
+    bool changed = false;
+
+    if (TaskReady(app_state->vaultTask)) {
+        VaultOpenResult result = app_state->vaultTask.get();
+        changed = true;
+
+        if (!result.unlocked) {
+            app_state->unlockMessage = app_state->unlockCreating ? "couldn't save the master password, see the log..." : "wrong master password...";
+            return changed;
+        }
+
+        if (!result.db) {
+            app_state->exit_app_loop = true;
+            return changed;
+        }
+
+        // the worker wakes the main loop out of SDL_WaitEvent when a result is ready to drain.
+        app_state->db.reset(new CipherSafe::DatabaseWorker(std::move(result.db), WakeMainLoop));
+
+        if (!app_state->settings->backup_dir.empty()) {
+            StartBackup(app_state);
+        }
+
+        StartupTimes& times = app_state->startup;
+        times.unlock = result.unlockMs;
+        times.open = result.openMs;
+        times.interactive = StartupTimes::MsSince(times.unlockStart);
+        ReportStartup(app_state);
+
+        app_state->consoleText = "vault unlocked in " + std::to_string(static_cast<int>(times.interactive)) + "ms...";
+    }
+
+    return changed;
+}
+
+// turns while ImGui draws frames, which IdleTimeout() keeps doing while a task runs.
+static char Spinner() {
+    const char spinner[] = "|/-\\";
+    return spinner[static_cast<int>(ImGui::GetTime() * 8) % 4];
+}
+
+static void DisplayUnlock(std::unique_ptr<AppState>& app_state) {
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+    ImGui::Begin("Unlock", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoResize);
+
+    // argon2 and opening the vault run in the background, PollStartup() swaps in the table.
+    if (app_state->vaultTask.valid()) {
+        ImGui::SeparatorText(app_state->unlockCreating ? "Creating the Vault" : "Unlocking CipherSafe");
+        ImGui::Spacing();
+        ImGui::Text("%c %s", Spinner(), "deriving the key from the master password...");
+        ImGui::End();
+        return;
+    }
+
+    bool creating = !app_state->crypt.has_master_password();
+
+    ImGui::SeparatorText(creating ? "Create a Master Password" : "Unlock CipherSafe");
+    ImGui::Spacing();
+    ImGui::Spacing();
+
+    if (creating) {
+        ImGui::Text("* it encrypts the vault key, a forgotten master password can't be recovered.");
+        ImGui::Spacing();
+        ImGui::Spacing();
+    }
+
+    const ImGuiInputTextFlags flags = ImGuiInputTextFlags_Password | ImGuiInputTextFlags_EnterReturnsTrue;
+    bool submit = false;
+
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("Master Password:");
+    if (ImGui::IsWindowAppearing()) {
+        ImGui::SetKeyboardFocusHere();
+    }
+    submit |= InputSecret("##master_password", &app_state->masterPassword, flags);
+
+    if (creating) {
+        ImGui::Text("Confirm Master Password:");
+        submit |= InputSecret("##master_password_confirm", &app_state->masterPasswordConfirm, flags);
+    }
+    ImGui::PopItemWidth();
+
+    ImGui::Spacing();
+    submit |= ImGui::Button(creating ? "Create" : "Unlock");
+
+    if (submit) {
+        UnlockVault(app_state);
+    }
+
+    if (!app_state->unlockMessage.empty()) {
+        ImGui::Spacing();
+        ImGui::Text("%s", app_state->unlockMessage.c_str());
+    }
+
+    ImGui::End();
 }
 
 static void DisplaySettings(std::unique_ptr<AppState>& app_state) {
@@ -754,6 +1528,13 @@ static void DisplaySettings(std::unique_ptr<AppState>& app_state) {
     ImGui::InputInt("##console_height", &app_state->settings->console_height);
     ImGui::PopItemWidth();
 
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("Max FPS (0 = vsync only, nothing is drawn while idle):");
+    ImGui::InputInt("##max_fps", &app_state->settings->max_fps);
+    ImGui::PopItemWidth();
+
     ImGui::Spacing();
     ImGui::Spacing();
     ImGui::SeparatorText("Font Settings");
@@ -825,6 +1606,99 @@ static void DisplaySettings(std::unique_ptr<AppState>& app_state) {
     ImGui::InputText("##greek_font", &app_state->settings->greek_font_path);
     ImGui::PopItemWidth();
 
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::SeparatorText("Import");
+
+    ImGui::Text("* CSV with a header row (title, url, username, password, category, notes).");
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("CSV File:");
+    ImGui::InputText("##import_path", &app_state->importPath);
+    ImGui::PopItemWidth();
+
+    if (ImGui::Button("Import CSV")) {
+        ImportCsv(app_state);
+    }
+
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::SeparatorText("Backup");
+
+    ImGui::Text("* encrypted snapshots of the vault, taken at startup and on demand.");
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("Backup Directory:");
+    ImGui::InputText("##backup_dir", &app_state->settings->backup_dir);
+    ImGui::Text("Backups To Keep:");
+    ImGui::InputInt("##backup_retention", &app_state->settings->backup_retention);
+    ImGui::PopItemWidth();
+
+    ImGui::BeginDisabled(app_state->backup->Running());
+    if (ImGui::Button("Back Up Now")) {
+        StartBackup(app_state);
+    }
+    ImGui::EndDisabled();
+
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::SeparatorText("Master Password");
+
+    ImGui::Text("* how hard the master password is to guess: slower unlocks are slower to brute force.");
+    ImGui::Text("* changes apply from the next unlock. last unlock took %dms.", static_cast<int>(app_state->crypt.unlock_seconds() * 1000));
+    ImGui::Spacing();
+    ImGui::Spacing();
+
+    const char* kdf_profiles[] = { "interactive", "moderate", "sensitive", "calibrated" };
+    int selected_kdf_profile = 1;
+    for (int i = 0; i < IM_ARRAYSIZE(kdf_profiles); i++) {
+        if (app_state->settings->kdf_profile == kdf_profiles[i]) {
+            selected_kdf_profile = i;
+        }
+    }
+
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("Key Derivation:");
+    if (ImGui::Combo("##kdf_profile", &selected_kdf_profile, kdf_profiles, IM_ARRAYSIZE(kdf_profiles))) {
+        app_state->settings->kdf_profile = kdf_profiles[selected_kdf_profile];
+    }
+    ImGui::Text("Target Unlock Time (ms):");
+    ImGui::InputInt("##kdf_target_ms", &app_state->settings->kdf_target_ms);
+    ImGui::PopItemWidth();
+
+    if (app_state->kdfTask.valid()) {
+        ImGui::Text("%c %s", Spinner(), "calibrating...");
+    } else if (ImGui::Button("Calibrate")) {
+        CalibrateKdf(app_state);
+    }
+
+    ImGui::Spacing();
+    ImGui::Spacing();
+    ImGui::SeparatorText("Storage");
+
+    ImGui::Text("* safe: every save is on disk before it returns.");
+    ImGui::Text("* balanced: faster saves, a power cut can lose the last few. fast: no syncing, a crash can corrupt the vault.");
+    ImGui::Text("* changes apply from the next unlock.");
+    ImGui::Spacing();
+    ImGui::Spacing();
+
+    const char* storage_profiles[] = { "safe", "balanced", "fast" };
+    int selected_storage_profile = 0;
+    for (int i = 0; i < IM_ARRAYSIZE(storage_profiles); i++) {
+        if (app_state->settings->storage_profile == storage_profiles[i]) {
+            selected_storage_profile = i;
+        }
+    }
+
+    ImGui::PushItemWidth(-1);
+    ImGui::Text("Durability:");
+    if (ImGui::Combo("##storage_profile", &selected_storage_profile, storage_profiles, IM_ARRAYSIZE(storage_profiles))) {
+        app_state->settings->storage_profile = storage_profiles[selected_storage_profile];
+    }
+    ImGui::PopItemWidth();
+
     ImGui::Spacing();
     ImGui::Spacing();
     ImGui::Spacing();
@@ -841,6 +1715,40 @@ static void DisplaySettings(std::unique_ptr<AppState>& app_state) {
     ImGui::End();
 }
 
+/*
+ * makes sure activeEntry and the updated_* strings hold the selected secret.
+ * false if it doesn't exist (anymore).
+ */
+static bool LoadActiveEntry(std::unique_ptr<AppState>& app_state) {
+    unsigned long generation = app_state->db->Generation();
+    bool loaded = app_state->currentActiveEntry != nullptr && app_state->activeEntryId == app_state->selectedEntryId;
+
+    // reloading now would clobber edits that haven't been written back yet.
+    if (loaded && (app_state->activeEntryGeneration == generation || app_state->dirtyFields != 0)) {
+        return true;
+    }
+
+    const CipherSafe::Database::Entry* entry = app_state->db->CachedEntry(app_state->selectedEntryId);
+    if (entry == nullptr) {
+        app_state->currentActiveEntry = nullptr;
+        return false;
+    }
+
+    app_state->activeEntry = *entry;
+    app_state->currentActiveEntry = &app_state->activeEntry;
+    app_state->activeEntryId = entry->id;
+    app_state->activeEntryGeneration = generation;
+
+    app_state->updated_title    = entry->title;
+    app_state->updated_url      = entry->url;
+    app_state->updated_username = entry->username;
+    app_state->updated_password = entry->password;
+    app_state->updated_category = entry->category;
+    app_state->updated_notes    = entry->notes;
+
+    return true;
+}
+
 static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
     if (!app_state->show_secret) {
         return;
@@ -848,22 +1756,14 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
 
     app_state->show_main_window = false;
 
-    std::unique_ptr<CipherSafe::Database::Entry> secret;
-
-    if (app_state->selectedEntryId) {
-        secret = app_state->db->GetEntryById(app_state->selectedEntryId);   
-
-        app_state->currentActiveEntry = secret.get();
-        app_state->updated_title    = app_state->currentActiveEntry->title;     
-        app_state->updated_url      = app_state->currentActiveEntry->url;
-        app_state->updated_username = app_state->currentActiveEntry->username;
-        app_state->updated_password = app_state->currentActiveEntry->password;
-        app_state->updated_category = app_state->currentActiveEntry->category;
-        app_state->updated_notes    = app_state->currentActiveEntry->notes;
-    } else {
+    if (!app_state->selectedEntryId || !LoadActiveEntry(app_state)) {
+        app_state->show_secret = false;
+        app_state->show_main_window = true;
         return;
     }
 
+    CipherSafe::Database::Entry* secret = app_state->currentActiveEntry;
+
     ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
     ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
     ImGui::Begin("Secret ", &app_state->show_secret, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoResize);
@@ -911,7 +1811,7 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
     ImGui::Spacing();
     ImGui::PushItemWidth(-1);
     ImGui::Text("Password");
-    ImGui::InputText("##password", &app_state->updated_password, app_state->input_flags | ImGuiInputTextFlags_CallbackEdit, PasswordInputTextUpdateCallback, app_state.get());
+    InputSecret("##password", &app_state->updated_password, app_state->input_flags | ImGuiInputTextFlags_CallbackEdit, PasswordInputTextUpdateCallback, app_state.get());
     ImGui::PopItemWidth();
 
     if (ImGui::Button("Copy Password")) {
@@ -930,7 +1830,7 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
     ImGui::Spacing();
     ImGui::PushItemWidth(-1);
     ImGui::Text("Notes:");
-    ImGui::InputTextMultiline("##notes", &app_state->updated_notes, ImVec2(450, 85), app_state->input_flags | ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_CallbackEdit, NotesInputTextUpdateCallback, app_state.get());
+    InputSecretMultiline("##notes", &app_state->updated_notes, ImVec2(450, 85), app_state->input_flags | ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_CallbackEdit, NotesInputTextUpdateCallback, app_state.get());
     ImGui::PopItemWidth();
 
     // Push red color styles for the delete button
@@ -952,19 +1852,19 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
         }
 
         if (app_state->delete_click_step == 3) {
-            if (app_state->db->RemoveEntryById(app_state->selectedEntryId)) {
-                app_state->consoleText = "successfully removed secret";
-                app_state->show_secret = false;
-                app_state->show_main_window = true;
-                app_state->delete_label = "Delete";
-                app_state->delete_click_step = 0;
-            } else {
-	      app_state->consoleText = "failed to remove secret";
-	      app_state->show_secret = false;
-              app_state->show_main_window = true;
-	      app_state->delete_label = "Delete";
-              app_state->delete_click_step = 0;
-	    }
+            app_state->dirtyFields = 0; // nothing left to write back to.
+
+            app_state->currentActiveEntry = nullptr;
+
+            AppState* state = app_state.get();
+            app_state->db->RemoveEntryById(app_state->selectedEntryId, [state](const CipherSafe::DatabaseWorker::Result& result) {
+                state->consoleText = result.ok ? "successfully removed secret" : "failed to remove secret";
+            });
+
+            app_state->show_secret = false;
+            app_state->show_main_window = true;
+            app_state->delete_label = "Delete";
+            app_state->delete_click_step = 0;
 	}
     }
 
@@ -999,6 +1899,7 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
             app_state->edit_label = "Edit";
             app_state->consoleText = "edit mode deactivated.";
             app_state->input_flags = ImGuiInputTextFlags_ReadOnly;
+            FlushPendingEdits(app_state);
         }
     }
 
@@ -1007,6 +1908,8 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
     ImGui::SameLine();
 
     if (ImGui::Button("Close")) {
+        FlushPendingEdits(app_state);
+
         app_state->show_main_window = true;
         app_state->show_secret = false;
 
@@ -1014,6 +1917,7 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
         app_state->input_flags = ImGuiInputTextFlags_ReadOnly;
         app_state->click_step = 1;
         app_state->clearUpdatedStrings();
+        app_state->currentActiveEntry = nullptr;
 
         app_state->delete_label = "Delete";
         app_state->delete_click_step = 0;
@@ -1021,18 +1925,36 @@ static void DisplaySecret(std::unique_ptr<AppState>& app_state) {
         app_state->consoleText = "idle.";
     }
 
+    // none of the fields has focus anymore, write back whatever was typed.
+    if (!ImGui::IsAnyItemActive()) {
+        FlushPendingEdits(app_state);
+    }
+
     DisplayConsole(app_state);
 
     ImGui::End();
 }
 
 static void MainWindowTearDown(std::unique_ptr<AppState>& app_state) {
+    // quitting mid-unlock: let the worker finish so the vault is closed cleanly.
+    if (app_state->vaultTask.valid()) {
+        VaultOpenResult result = app_state->vaultTask.get();
+        if (result.db) {
+            result.db->Close();
+        }
+    }
+
+    // Database::Close() drops the page key the backup reads with.
+    if (app_state->backup) {
+        app_state->backup->Wait();
+    }
+
     if (app_state->db) {
+        // every commit is already encrypted on disk, this just writes the last pending edits.
+        FlushPendingEdits(app_state);
         app_state->db->Close();
     }
 
-    app_state->crypt.encrypt_file();
-
     ImGui_ImplOpenGL2_Shutdown();
 
     ImGui_ImplSDL2_Shutdown();
@@ -1054,25 +1976,9 @@ static void MainWindowTearDown(std::unique_ptr<AppState>& app_state) {
     SDL_Quit();
 }
 
-static std::string randomString(size_t length) {
-    const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()-_=+";
-    const size_t max_index = sizeof(charset) - 1;
-
-    std::string password;
-    password.reserve(length);
-
-    // Buffer to hold random bytes
-    std::vector<unsigned char> buffer(length);
-    randombytes_buf(buffer.data(), buffer.size());
-
-    for (size_t i = 0; i < length; ++i) {
-        password += charset[buffer[i] % max_index];
-    }
-
-    return password;
-}
-
 int main(int argc, char* argv[]) {
+    auto process_start = std::chrono::steady_clock::now();
+
     if (!InitApp()) {
         return 1;
     }
@@ -1091,20 +1997,25 @@ int main(int argc, char* argv[]) {
     std::unique_ptr<CipherSafe::Settings> app_settings( new CipherSafe::Settings(app_work_dir_value) );
 
     std::unique_ptr<AppState> state(new AppState);
+    state->startup.start = process_start;
     //state->init("./"); // used for testing within the build dir. use when modifying crypt.cpp.
     state->crypt.init(app_work_dir_value);
-    state->crypt.decrypt_file();
+    state->backup.reset(new CipherSafe::Backup(state->crypt, WakeMainLoop));
+
     state->show_main_window = true;
     state->show_console     = true;
     state->show_add_form    = false;
     state->show_secret      = false;
     state->settings         = std::move(app_settings);
 
-    const std::string dbPath = app_work_dir_value + "core.db";
-    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(dbPath));
-    state->db = std::move(db);
-
+    // the vault is opened by the unlock screen, once the master password is in.
+    StartFontLoad(state);
     InitSDL(state);
+    state->startup.Mark(state->startup.window);
+
+    // draw a few frames after every event, then sleep until the next one.
+    const int ACTIVE_FRAMES = 3;
+    state->activeFrames = ACTIVE_FRAMES;
 
     // Main loop
     while (!state->exit_app_loop) {
@@ -1113,8 +2024,20 @@ int main(int argc, char* argv[]) {
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application, or clear/overwrite your copy of the mouse data.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+        auto frame_start = std::chrono::steady_clock::now();
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
+        int has_event;
+
+        if (state->activeFrames > 0) {
+            has_event = SDL_PollEvent(&event);
+        } else {
+            // nothing is changing on screen, so sleep until there is input or a timer is due.
+            int timeout = IdleTimeout(state);
+            has_event = timeout < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, timeout);
+        }
+
+        for (; has_event; has_event = SDL_PollEvent(&event)) {
+            state->activeFrames = ACTIVE_FRAMES;
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT)
                 state->exit_app_loop = true;
@@ -1125,6 +2048,29 @@ int main(int argc, char* argv[]) {
                 event.window.windowID == SDL_GetWindowID(state->windowContext.window)
                 )
                 state->exit_app_loop = true;
+
+            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+                FlushPendingEdits(state);
+        }
+
+        if (PollImportProgress(state)) {
+            state->activeFrames = ACTIVE_FRAMES;
+        }
+
+        if (state->db && state->db->Drain() > 0) {
+            state->activeFrames = ACTIVE_FRAMES;
+        }
+
+        FlushIdleEdits(state);
+
+        if (PollStartup(state) || PollKdfCalibration(state)) {
+            state->activeFrames = ACTIVE_FRAMES;
+        }
+
+        std::string backup_message;
+        if (state->backup->Poll(backup_message)) {
+            state->consoleText = backup_message;
+            state->activeFrames = ACTIVE_FRAMES;
         }
 
         // Start the Dear ImGui frame
@@ -1132,10 +2078,14 @@ int main(int argc, char* argv[]) {
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
 
-        ShowMainWindow(state);
-        DisplayAddForm(state);
-        DisplaySecret(state);
-        DisplaySettings(state);
+        if (state->db) {
+            ShowMainWindow(state);
+            DisplayAddForm(state);
+            DisplaySecret(state);
+            DisplaySettings(state);
+        } else {
+            DisplayUnlock(state);
+        }
 
         // Rendering
         ImGui::Render();
@@ -1159,6 +2109,16 @@ int main(int argc, char* argv[]) {
         ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
 
         SDL_GL_SwapWindow(state->windowContext.window);
+        state->startup.Mark(state->startup.firstFrame);
+
+        if (state->activeFrames > 0) {
+            state->activeFrames--;
+        }
+
+        // vsync already paces us, max_fps is for displays (or drivers) where it doesn't.
+        if (state->settings->max_fps > 0) {
+            std::this_thread::sleep_until(frame_start + std::chrono::microseconds(1000000 / state->settings->max_fps));
+        }
     }
 
     MainWindowTearDown(state);
@@ -0,0 +1,67 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace CipherSafe {
+
+  /*
+   * lock-free queue for many producers and a single consumer (Vyukov's
+   * intrusive MPSC queue). Push() is one atomic exchange and never waits on
+   * other producers or the consumer. Pop() may only be called from one
+   * thread, and can briefly see the queue as empty while a Push() is halfway
+   * through; callers that count their items just try again.
+   *
+   * T has to be default constructible (the queue keeps one empty node).
+   */
+  template <typename T>
+  class MpscQueue {
+  public:
+    MpscQueue(): head(new Node()), tail(head.load()) {}
+
+    ~MpscQueue() {
+      T value;
+      while (Pop(value)) {}
+      delete this->tail;
+    }
+
+    void Push(T value) {
+      Node* node = new Node();
+      node->value = std::move(value);
+
+      Node* previous = this->head.exchange(node, std::memory_order_acq_rel);
+      previous->next.store(node, std::memory_order_release);
+    }
+
+    // consumer thread only.
+    bool Pop(T& value) {
+      Node* next = this->tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        return false;
+      }
+
+      // `next` becomes the empty node, its value moves out.
+      value = std::move(next->value);
+      delete this->tail;
+      this->tail = next;
+
+      return true;
+    }
+
+  private:
+    struct Node {
+      std::atomic<Node*> next;
+      T value;
+
+      Node(): next(nullptr) {}
+    };
+
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+
+    std::atomic<Node*> head; // last pushed, producers swap themselves in here
+    Node* tail;              // the empty node before the oldest item, consumer only
+  };
+}
+#endif
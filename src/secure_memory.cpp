@@ -0,0 +1,285 @@
+#include "secure_memory.h"
+
+using namespace CipherSafe;
+
+SecureArena& SecureArena::Session() {
+    static SecureArena arena;
+    return arena;
+}
+
+SecureArena::SecureArena() {
+    // sodium_malloc() needs the page size sodium_init() looks up.
+    if (sodium_init() < 0) {
+        throw std::runtime_error("libsodium couldn't be initialized");
+    }
+}
+
+SecureArena::~SecureArena() {
+    // sodium_free() wipes each block before handing it back.
+    for (unsigned char* block : this->blocks) {
+        sodium_free(block);
+    }
+}
+
+size_t SecureArena::chunk_class(size_t size) {
+    size_t index = 0;
+
+    for (size_t chunk = MIN_CHUNK; chunk < size; chunk <<= 1) {
+        index++;
+    }
+
+    return index;
+}
+
+void* SecureArena::Allocate(size_t size, size_t& capacity) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (size > MAX_CHUNK) {
+        void* chunk = sodium_malloc(size);
+        if (chunk == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        capacity = size;
+        this->reserved += size;
+        this->in_use += size;
+        return chunk;
+    }
+
+    size_t index = chunk_class(size);
+    capacity = MIN_CHUNK << index;
+    this->in_use += capacity;
+
+    std::vector<void*>& free_chunks = this->free_chunks[index];
+    if (!free_chunks.empty()) {
+        void* chunk = free_chunks.back();
+        free_chunks.pop_back();
+        return chunk;
+    }
+
+    if (this->left < capacity) {
+        unsigned char* block = static_cast<unsigned char*>(sodium_malloc(BLOCK_SIZE));
+        if (block == nullptr) {
+            this->in_use -= capacity;
+            throw std::bad_alloc();
+        }
+
+        this->blocks.push_back(block);
+        this->reserved += BLOCK_SIZE;
+        this->next = block;
+        this->left = BLOCK_SIZE;
+    }
+
+    void* chunk = this->next;
+    this->next += capacity;
+    this->left -= capacity;
+    return chunk;
+}
+
+void SecureArena::Release(void* chunk, size_t capacity) {
+    if (chunk == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->in_use -= capacity;
+
+    if (capacity > MAX_CHUNK) {
+        this->reserved -= capacity;
+        sodium_free(chunk);
+        return;
+    }
+
+    sodium_memzero(chunk, capacity);
+    this->free_chunks[chunk_class(capacity)].push_back(chunk);
+}
+
+size_t SecureArena::BytesReserved() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->reserved;
+}
+
+size_t SecureArena::BytesInUse() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->in_use;
+}
+
+SecureString::SecureString() {}
+
+SecureString::SecureString(const char* text) {
+    assign(text, std::strlen(text));
+}
+
+SecureString::SecureString(const char* text, size_t length) {
+    assign(text, length);
+}
+
+SecureString::SecureString(const std::string& text) {
+    assign(text.data(), text.size());
+}
+
+SecureString::SecureString(const SecureString& other) {
+    assign(other.buffer, other.used);
+}
+
+SecureString::SecureString(SecureString&& other) noexcept: buffer(other.buffer), used(other.used), chunk(other.chunk) {
+    other.buffer = nullptr;
+    other.used = 0;
+    other.chunk = 0;
+}
+
+SecureString::~SecureString() {
+    SecureArena::Session().Release(this->buffer, this->chunk);
+}
+
+SecureString& SecureString::operator=(const char* text) {
+    return assign(text, std::strlen(text));
+}
+
+SecureString& SecureString::operator=(const std::string& text) {
+    return assign(text.data(), text.size());
+}
+
+SecureString& SecureString::operator=(const SecureString& other) {
+    if (this != &other) {
+        assign(other.buffer, other.used);
+    }
+    return *this;
+}
+
+SecureString& SecureString::operator=(SecureString&& other) noexcept {
+    if (this != &other) {
+        SecureArena::Session().Release(this->buffer, this->chunk);
+
+        this->buffer = other.buffer;
+        this->used = other.used;
+        this->chunk = other.chunk;
+
+        other.buffer = nullptr;
+        other.used = 0;
+        other.chunk = 0;
+    }
+    return *this;
+}
+
+SecureString& SecureString::assign(const char* text, size_t length) {
+    resize(0);
+    return append(text, length);
+}
+
+SecureString& SecureString::append(const char* text, size_t length) {
+    if (length == 0) {
+        return *this;
+    }
+
+    reserve(this->used + length);
+    std::memmove(this->buffer + this->used, text, length);
+    this->used += length;
+    this->buffer[this->used] = '\0';
+
+    return *this;
+}
+
+SecureString& SecureString::operator+=(char c) {
+    return append(&c, 1);
+}
+
+const char* SecureString::c_str() const {
+    return this->buffer != nullptr ? this->buffer : "";
+}
+
+const char* SecureString::data() const {
+    return c_str();
+}
+
+char* SecureString::data() {
+    // callers (ImGui) may write the terminating NUL, so never hand out the "" literal.
+    reserve(this->used);
+    return this->buffer;
+}
+
+size_t SecureString::size() const {
+    return this->used;
+}
+
+size_t SecureString::length() const {
+    return this->used;
+}
+
+size_t SecureString::capacity() const {
+    return this->chunk > 0 ? this->chunk - 1 : 0;
+}
+
+bool SecureString::empty() const {
+    return this->used == 0;
+}
+
+void SecureString::clear() {
+    resize(0);
+}
+
+void SecureString::reserve(size_t length) {
+    if (this->buffer != nullptr && length < this->chunk) {
+        return;
+    }
+
+    // grow by at least half, so appending a character at a time stays cheap past MAX_CHUNK too.
+    size_t wanted = std::max(length + 1, this->chunk + this->chunk / 2);
+    size_t chunk;
+    char* buffer = static_cast<char*>(SecureArena::Session().Allocate(wanted, chunk));
+
+    if (this->buffer != nullptr) {
+        std::memcpy(buffer, this->buffer, this->used);
+    }
+    buffer[this->used] = '\0';
+
+    SecureArena::Session().Release(this->buffer, this->chunk);
+    this->buffer = buffer;
+    this->chunk = chunk;
+}
+
+void SecureString::resize(size_t length, char c) {
+    if (length > this->used) {
+        reserve(length);
+        std::memset(this->buffer + this->used, c, length - this->used);
+    } else if (this->buffer != nullptr) {
+        sodium_memzero(this->buffer + length, this->used - length);
+    }
+
+    this->used = length;
+    if (this->buffer != nullptr) {
+        this->buffer[length] = '\0';
+    }
+}
+
+bool SecureString::equals(const char* text, size_t length) const {
+    return this->used == length && (length == 0 || std::memcmp(this->buffer, text, length) == 0);
+}
+
+bool SecureString::operator==(const SecureString& other) const {
+    return equals(other.c_str(), other.used);
+}
+
+bool SecureString::operator==(const char* text) const {
+    return equals(text, std::strlen(text));
+}
+
+bool SecureString::operator==(const std::string& text) const {
+    return equals(text.data(), text.size());
+}
+
+bool SecureString::operator!=(const SecureString& other) const {
+    return !(*this == other);
+}
+
+bool SecureString::operator!=(const char* text) const {
+    return !(*this == text);
+}
+
+bool SecureString::operator!=(const std::string& text) const {
+    return !(*this == text);
+}
+
+std::ostream& CipherSafe::operator<<(std::ostream& out, const SecureString& text) {
+    return out.write(text.c_str(), static_cast<std::streamsize>(text.size()));
+}
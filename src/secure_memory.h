@@ -0,0 +1,121 @@
+#ifndef SECURE_MEMORY_H
+#define SECURE_MEMORY_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+#include <sodium.h>
+
+namespace CipherSafe {
+
+  /*
+   * memory for secrets: it comes from sodium_malloc() in big blocks, so
+   * it is locked out of swap and fenced by guard pages, with one mlock per
+   * block instead of one per string.
+   *
+   * chunks are bumped out of the current block in power of two sizes and
+   * go back to a free list per size once released (wiped first), so editing
+   * a password over and over reuses the same few chunks instead of
+   * fragmenting the heap. chunks bigger than a quarter block get their own
+   * sodium_malloc(). everything is wiped and released in one go when the
+   * arena is destroyed at exit.
+   */
+  class SecureArena {
+  public:
+    // the arena used by SecureString, alive for the whole session.
+    static SecureArena& Session();
+
+    SecureArena();
+    ~SecureArena();
+
+    // returns a chunk of at least `size` bytes, its real size goes to `capacity`.
+    void* Allocate(size_t size, size_t& capacity);
+    // wipes the chunk and keeps it for reuse.
+    void Release(void* chunk, size_t capacity);
+
+    size_t BytesReserved() const; // taken from sodium_malloc
+    size_t BytesInUse() const;    // handed out and not released yet
+
+    static const size_t BLOCK_SIZE = 256 * 1024;
+    static const size_t MIN_CHUNK = 16;
+    static const size_t MAX_CHUNK = BLOCK_SIZE / 4;
+
+  private:
+    SecureArena(const SecureArena&);
+    SecureArena& operator=(const SecureArena&);
+
+    static const size_t CHUNK_CLASSES = 13; // 16 bytes to MAX_CHUNK
+
+    mutable std::mutex mutex;
+    std::vector<unsigned char*> blocks;
+    unsigned char* next = nullptr;
+    size_t left = 0;
+    std::vector<void*> free_chunks[CHUNK_CLASSES];
+    size_t reserved = 0;
+    size_t in_use = 0;
+
+    static size_t chunk_class(size_t size);
+  };
+
+  /*
+   * a string whose characters only ever live in the SecureArena. unlike
+   * std::string there is no small string buffer inside the object, and
+   * every byte it stops using (shrinking, reallocating, clear(), the
+   * destructor) is wiped.
+   *
+   * only what the app needs of the std::string interface is here.
+   */
+  class SecureString {
+  public:
+    SecureString();
+    SecureString(const char* text);
+    SecureString(const char* text, size_t length);
+    SecureString(const std::string& text);
+    SecureString(const SecureString& other);
+    SecureString(SecureString&& other) noexcept;
+    ~SecureString();
+
+    SecureString& operator=(const char* text);
+    SecureString& operator=(const std::string& text);
+    SecureString& operator=(const SecureString& other);
+    SecureString& operator=(SecureString&& other) noexcept;
+
+    SecureString& assign(const char* text, size_t length);
+    SecureString& append(const char* text, size_t length);
+    SecureString& operator+=(char c);
+
+    const char* c_str() const;
+    const char* data() const;
+    char* data();
+    size_t size() const;
+    size_t length() const;
+    size_t capacity() const;
+    bool empty() const;
+
+    void clear();
+    void reserve(size_t length);
+    void resize(size_t length, char c = '\0');
+
+    bool operator==(const SecureString& other) const;
+    bool operator==(const char* text) const;
+    bool operator==(const std::string& text) const;
+    bool operator!=(const SecureString& other) const;
+    bool operator!=(const char* text) const;
+    bool operator!=(const std::string& text) const;
+
+  private:
+    char* buffer = nullptr;
+    size_t used = 0;
+    size_t chunk = 0; // bytes in buffer, including room for the NUL
+
+    bool equals(const char* text, size_t length) const;
+  };
+
+  std::ostream& operator<<(std::ostream& out, const SecureString& text);
+}
+#endif
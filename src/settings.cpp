@@ -30,6 +30,20 @@ bool Settings::Load() {
     ini["ciphersafe_settings"]["chinese_font"] = this->chinese_font_path;
     ini["ciphersafe_settings"]["thai_font"] = this->thai_font_path;
     ini["ciphersafe_settings"]["viet_font"] = this->viet_font_path;
+    ini["ciphersafe_settings"]["backup_dir"] = this->backup_dir;
+    ini["ciphersafe_settings"]["backup_retention"] = std::to_string(this->backup_retention);
+    ini["ciphersafe_settings"]["max_fps"] = std::to_string(this->max_fps);
+    ini["ciphersafe_settings"]["kdf_profile"] = this->kdf_profile;
+    ini["ciphersafe_settings"]["kdf_target_ms"] = std::to_string(this->kdf_target_ms);
+    ini["ciphersafe_settings"]["kdf_opslimit"] = std::to_string(this->kdf_opslimit);
+    ini["ciphersafe_settings"]["kdf_memlimit"] = std::to_string(this->kdf_memlimit);
+    ini["ciphersafe_settings"]["storage_profile"] = this->storage_profile;
+    ini["ciphersafe_settings"]["storage_journal_mode"] = this->storage_journal_mode;
+    ini["ciphersafe_settings"]["storage_synchronous"] = this->storage_synchronous;
+    ini["ciphersafe_settings"]["storage_temp_store"] = this->storage_temp_store;
+    ini["ciphersafe_settings"]["storage_cache_size"] = std::to_string(this->storage_cache_size);
+    ini["ciphersafe_settings"]["storage_mmap_size"] = std::to_string(this->storage_mmap_size);
+    ini["ciphersafe_settings"]["storage_page_size"] = std::to_string(this->storage_page_size);
 
     file.generate(ini);
   }
@@ -48,6 +62,59 @@ bool Settings::Load() {
     this->korean_font_path = ini["ciphersafe_settings"]["korean_font"];
     this->chinese_font_path = ini["ciphersafe_settings"]["chinese_font"];
     this->viet_font_path = ini["ciphersafe_settings"]["viet_font"];
+    this->backup_dir = ini["ciphersafe_settings"]["backup_dir"];
+
+    // older settings.ini files don't have these yet.
+    const std::string& backup_retention = ini["ciphersafe_settings"]["backup_retention"];
+    if (!backup_retention.empty()) {
+      this->backup_retention = std::stoi(backup_retention);
+    }
+
+    const std::string& max_fps = ini["ciphersafe_settings"]["max_fps"];
+    if (!max_fps.empty()) {
+      this->max_fps = std::stoi(max_fps);
+    }
+
+    const std::string& kdf_profile = ini["ciphersafe_settings"]["kdf_profile"];
+    if (!kdf_profile.empty()) {
+      this->kdf_profile = kdf_profile;
+    }
+
+    const std::string& kdf_target_ms = ini["ciphersafe_settings"]["kdf_target_ms"];
+    if (!kdf_target_ms.empty()) {
+      this->kdf_target_ms = std::stoi(kdf_target_ms);
+    }
+
+    const std::string& kdf_opslimit = ini["ciphersafe_settings"]["kdf_opslimit"];
+    const std::string& kdf_memlimit = ini["ciphersafe_settings"]["kdf_memlimit"];
+    if (!kdf_opslimit.empty() && !kdf_memlimit.empty()) {
+      this->kdf_opslimit = std::stoull(kdf_opslimit);
+      this->kdf_memlimit = std::stoull(kdf_memlimit);
+    }
+
+    const std::string& storage_profile = ini["ciphersafe_settings"]["storage_profile"];
+    if (!storage_profile.empty()) {
+      this->storage_profile = storage_profile;
+    }
+
+    this->storage_journal_mode = ini["ciphersafe_settings"]["storage_journal_mode"];
+    this->storage_synchronous = ini["ciphersafe_settings"]["storage_synchronous"];
+    this->storage_temp_store = ini["ciphersafe_settings"]["storage_temp_store"];
+
+    const std::string& storage_cache_size = ini["ciphersafe_settings"]["storage_cache_size"];
+    if (!storage_cache_size.empty()) {
+      this->storage_cache_size = std::stoi(storage_cache_size);
+    }
+
+    const std::string& storage_mmap_size = ini["ciphersafe_settings"]["storage_mmap_size"];
+    if (!storage_mmap_size.empty()) {
+      this->storage_mmap_size = std::stoll(storage_mmap_size);
+    }
+
+    const std::string& storage_page_size = ini["ciphersafe_settings"]["storage_page_size"];
+    if (!storage_page_size.empty()) {
+      this->storage_page_size = std::stoi(storage_page_size);
+    }
     did_load = true;
   }
 
@@ -76,6 +143,11 @@ bool Settings::Save() {
   }
   ini["ciphersafe_settings"]["password_length"] = std::to_string(this->password_length);
 
+  if (this->max_fps < 0 || this->max_fps > 240) {
+    this->max_fps = 60;
+  }
+  ini["ciphersafe_settings"]["max_fps"] = std::to_string(this->max_fps);
+
   if (this->dark_mode.empty()) {
     this->dark_mode = "dark";
   }
@@ -94,6 +166,67 @@ bool Settings::Save() {
   ini["ciphersafe_settings"]["thai_font"] = this->thai_font_path;
   ini["ciphersafe_settings"]["viet_font"] = this->viet_font_path;
 
+  // BACKUPS
+  if (this->backup_retention <= 0 || this->backup_retention > 1000) {
+    this->backup_retention = 10;
+  }
+  ini["ciphersafe_settings"]["backup_dir"] = this->backup_dir;
+  ini["ciphersafe_settings"]["backup_retention"] = std::to_string(this->backup_retention);
+
+  // KEY DERIVATION
+  if (this->kdf_profile != "interactive" && this->kdf_profile != "moderate" &&
+      this->kdf_profile != "sensitive" && this->kdf_profile != "calibrated") {
+    this->kdf_profile = "moderate";
+  }
+
+  // never calibrated: nothing to use yet.
+  if (this->kdf_profile == "calibrated" && (this->kdf_opslimit == 0 || this->kdf_memlimit == 0)) {
+    this->kdf_profile = "moderate";
+  }
+
+  if (this->kdf_target_ms < 100 || this->kdf_target_ms > 10000) {
+    this->kdf_target_ms = 1000;
+  }
+  ini["ciphersafe_settings"]["kdf_profile"] = this->kdf_profile;
+  ini["ciphersafe_settings"]["kdf_target_ms"] = std::to_string(this->kdf_target_ms);
+  ini["ciphersafe_settings"]["kdf_opslimit"] = std::to_string(this->kdf_opslimit);
+  ini["ciphersafe_settings"]["kdf_memlimit"] = std::to_string(this->kdf_memlimit);
+
+  // STORAGE
+  if (this->storage_profile != "safe" && this->storage_profile != "balanced" && this->storage_profile != "fast") {
+    this->storage_profile = "safe";
+  }
+
+  for (std::string* keyword : { &this->storage_journal_mode, &this->storage_synchronous, &this->storage_temp_store }) {
+    std::transform(keyword->begin(), keyword->end(), keyword->begin(), [](char c) { return static_cast<char>(std::toupper(c)); });
+  }
+
+  // journal_mode=OFF is left out on purpose: a crash mid commit would corrupt the vault.
+  if (!one_of(this->storage_journal_mode, { "", "WAL", "DELETE", "TRUNCATE", "PERSIST", "MEMORY" })) {
+    this->storage_journal_mode = "";
+  }
+  if (!one_of(this->storage_synchronous, { "", "OFF", "NORMAL", "FULL", "EXTRA" })) {
+    this->storage_synchronous = "";
+  }
+  if (!one_of(this->storage_temp_store, { "", "DEFAULT", "FILE", "MEMORY" })) {
+    this->storage_temp_store = "";
+  }
+  if (this->storage_mmap_size < -1) {
+    this->storage_mmap_size = -1;
+  }
+  // a power of two from 512 to 65536.
+  if (this->storage_page_size != 0 && (this->storage_page_size < 512 || this->storage_page_size > 65536 ||
+      (this->storage_page_size & (this->storage_page_size - 1)) != 0)) {
+    this->storage_page_size = 0;
+  }
+  ini["ciphersafe_settings"]["storage_profile"] = this->storage_profile;
+  ini["ciphersafe_settings"]["storage_journal_mode"] = this->storage_journal_mode;
+  ini["ciphersafe_settings"]["storage_synchronous"] = this->storage_synchronous;
+  ini["ciphersafe_settings"]["storage_temp_store"] = this->storage_temp_store;
+  ini["ciphersafe_settings"]["storage_cache_size"] = std::to_string(this->storage_cache_size);
+  ini["ciphersafe_settings"]["storage_mmap_size"] = std::to_string(this->storage_mmap_size);
+  ini["ciphersafe_settings"]["storage_page_size"] = std::to_string(this->storage_page_size);
+
   if (file.write(ini)) {
     did_save = true;
   }
@@ -101,6 +234,15 @@ bool Settings::Save() {
   return did_save;
 }
 
+bool Settings::one_of(const std::string& value, std::initializer_list<const char*> allowed) {
+  for (const char* option : allowed) {
+    if (value == option) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool Settings::ini_file_exists() {
   if (this->settings_file_path.empty()) {
     std::cerr << "Could not find settings.ini file: path is empty" << std::endl;
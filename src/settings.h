@@ -5,6 +5,9 @@
 #include <fstream>
 #include "../ext_libs/mINI/src/mini/ini.h"
 #include <string>
+#include <initializer_list>
+#include <algorithm>
+#include <cctype>
 
 namespace CipherSafe {
   class Settings {
@@ -25,6 +28,24 @@ namespace CipherSafe {
     double font_size = 18.0f;
     int console_height = 24;
     int password_length = 18;
+    int backup_retention = 10;
+    int max_fps = 60; // while something is happening on screen, 0 = vsync only
+
+    // master password key derivation: interactive, moderate, sensitive or calibrated.
+    std::string kdf_profile = "moderate";
+    int kdf_target_ms = 1000; // what calibration aims for
+    unsigned long long kdf_opslimit = 0; // the calibrated parameters
+    unsigned long long kdf_memlimit = 0;
+
+    // vault storage tuning: safe, balanced or fast, applied when the vault is opened.
+    std::string storage_profile = "safe";
+    // overrides for single knobs of the profile, empty / 0 / -1 = keep the profile's.
+    std::string storage_journal_mode = "";
+    std::string storage_synchronous = "";
+    std::string storage_temp_store = "";
+    int storage_cache_size = 0;
+    long long storage_mmap_size = -1;
+    int storage_page_size = 0;
 
     bool Save();
 
@@ -33,6 +54,7 @@ namespace CipherSafe {
     std::string settings_file_path = "";
     bool Load(); 
     bool ini_file_exists();
+    static bool one_of(const std::string& value, std::initializer_list<const char*> allowed);
   };
 
 }
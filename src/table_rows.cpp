@@ -0,0 +1,197 @@
+#include "table_rows.h"
+
+using namespace CipherSafe;
+
+static const std::collate<char>& user_collation() {
+    static const std::locale locale = []() -> std::locale {
+        try {
+            return std::locale("");
+        } catch (const std::runtime_error&) {
+            // LANG names a locale that isn't installed.
+            return std::locale::classic();
+        }
+    }();
+
+    return std::use_facet<std::collate<char>>(locale);
+}
+
+// a key that sorts like the text would, case-insensitively, in the user's locale.
+static std::string collation_key(const char* text) {
+    std::string folded(text);
+    std::transform(folded.begin(), folded.end(), folded.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    return user_collation().transform(folded.data(), folded.data() + folded.size());
+}
+
+void TableRows::Clear() {
+    this->ids.clear();
+    this->id_labels.clear();
+    this->titles.clear();
+    this->urls.clear();
+    this->categories.clear();
+    this->strings.clear();
+    this->interned.clear();
+
+    for (auto& order : this->orders) {
+        order.clear();
+    }
+}
+
+void TableRows::Reserve(size_t rows) {
+    this->ids.reserve(rows);
+    this->id_labels.reserve(rows);
+    this->titles.reserve(rows);
+    this->urls.reserve(rows);
+    this->categories.reserve(rows);
+}
+
+void TableRows::Add(const Database::Entry& entry) {
+    char label[16];
+    int length = std::snprintf(label, sizeof(label), "%d", entry.id);
+
+    this->ids.push_back(entry.id);
+    this->id_labels.push_back(append(label, static_cast<size_t>(length)));
+    this->titles.push_back(intern(entry.title));
+    this->urls.push_back(intern(entry.url));
+    this->categories.push_back(intern(entry.category));
+
+    for (auto& order : this->orders) {
+        order.clear();
+    }
+}
+
+size_t TableRows::Size() const {
+    return this->ids.size();
+}
+
+bool TableRows::Empty() const {
+    return this->ids.empty();
+}
+
+int TableRows::Id(size_t row) const {
+    return this->ids[row];
+}
+
+const char* TableRows::IdLabel(size_t row) const {
+    return &this->strings[this->id_labels[row]];
+}
+
+const char* TableRows::Title(size_t row) const {
+    return &this->strings[this->titles[row]];
+}
+
+const char* TableRows::Url(size_t row) const {
+    return &this->strings[this->urls[row]];
+}
+
+const char* TableRows::Category(size_t row) const {
+    return &this->strings[this->categories[row]];
+}
+
+void TableRows::Sort(int column, bool descending) {
+    if (column < 0 || column >= COLUMN_COUNT) {
+        column = UNSORTED;
+    }
+
+    this->sort_column = column;
+    this->sort_descending = descending;
+
+    if (column != UNSORTED && this->orders[column].size() != this->ids.size()) {
+        build_order(column);
+    }
+}
+
+size_t TableRows::Row(size_t position) const {
+    if (this->sort_column == UNSORTED) {
+        return this->sort_descending ? this->ids.size() - 1 - position : position;
+    }
+
+    const std::vector<uint32_t>& order = this->orders[this->sort_column];
+    return this->sort_descending ? order[order.size() - 1 - position] : order[position];
+}
+
+const std::vector<uint32_t>& TableRows::column_offsets(int column) const {
+    switch (column) {
+        case COLUMN_TITLE: return this->titles;
+        case COLUMN_URL:   return this->urls;
+        default:           return this->categories;
+    }
+}
+
+void TableRows::build_order(int column) {
+    std::vector<uint32_t>& order = this->orders[column];
+    const std::vector<int>& ids = this->ids;
+
+    order.resize(ids.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    if (column == COLUMN_ID) {
+        std::sort(order.begin(), order.end(), [&ids](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+        return;
+    }
+
+    /*
+     * collation keys are expensive, so they are made once per distinct
+     * string (interning already merged the duplicates) and turned into
+     * integer ranks; the row sort then only compares ranks.
+     */
+    const std::vector<uint32_t>& offsets = column_offsets(column);
+    std::unordered_map<uint32_t, uint32_t> ranks;
+    std::vector<std::pair<std::string, uint32_t>> keys;
+
+    for (uint32_t offset : offsets) {
+        if (ranks.insert(std::make_pair(offset, 0)).second) {
+            keys.push_back(std::make_pair(collation_key(&this->strings[offset]), offset));
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    uint32_t rank = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        // strings that only differ in case share a rank.
+        if (i > 0 && keys[i].first != keys[i - 1].first) {
+            rank++;
+        }
+        ranks[keys[i].second] = rank;
+    }
+
+    std::vector<uint32_t> row_ranks(offsets.size());
+    for (size_t i = 0; i < offsets.size(); i++) {
+        row_ranks[i] = ranks[offsets[i]];
+    }
+
+    std::sort(order.begin(), order.end(), [&row_ranks, &ids](uint32_t a, uint32_t b) {
+        return row_ranks[a] != row_ranks[b] ? row_ranks[a] < row_ranks[b] : ids[a] < ids[b];
+    });
+}
+
+uint32_t TableRows::append(const char* text, size_t length) {
+    uint32_t offset = static_cast<uint32_t>(this->strings.size());
+
+    this->strings.insert(this->strings.end(), text, text + length);
+    this->strings.push_back('\0');
+
+    return offset;
+}
+
+uint32_t TableRows::intern(const std::string& text) {
+    // only the hash is kept in the map, the string itself lives in `strings` once.
+    size_t hash = std::hash<std::string>()(text);
+    auto range = this->interned.equal_range(hash);
+
+    for (auto it = range.first; it != range.second; ++it) {
+        const char* stored = &this->strings[it->second];
+
+        if (std::strlen(stored) == text.size() && std::memcmp(stored, text.data(), text.size()) == 0) {
+            return it->second;
+        }
+    }
+
+    uint32_t offset = append(text.data(), text.size());
+    this->interned.insert(std::make_pair(hash, offset));
+
+    return offset;
+}
@@ -0,0 +1,86 @@
+#ifndef TABLE_ROWS_H
+#define TABLE_ROWS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <locale>
+#include <cctype>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "database.h"
+
+namespace CipherSafe {
+
+  /*
+   * the rows of the secrets table, stored column by column so drawing the
+   * visible slice of a big vault touches as little memory as possible:
+   * one contiguous array of ids, and for every text column an array of
+   * offsets into a single buffer of NUL terminated strings. equal strings
+   * (the same url or category on many rows) are stored once, and the id
+   * labels are formatted once when the rows are built instead of every frame.
+   *
+   * the returned pointers stay valid until the next Clear()/Add().
+   *
+   * sorting goes through Row(): the rows themselves never move, each column
+   * keeps a cached permutation that is only rebuilt after the rows change.
+   */
+  class TableRows {
+  public:
+    enum Column {
+      COLUMN_ID,
+      COLUMN_TITLE,
+      COLUMN_URL,
+      COLUMN_CATEGORY,
+      COLUMN_COUNT
+    };
+
+    // the order the rows were added in, e.g best search match first.
+    static const int UNSORTED = -1;
+
+    void Clear();
+    void Reserve(size_t rows);
+    void Add(const Database::Entry& entry);
+
+    size_t Size() const;
+    bool Empty() const;
+
+    int Id(size_t row) const;
+    const char* IdLabel(size_t row) const;
+    const char* Title(size_t row) const;
+    const char* Url(size_t row) const;
+    const char* Category(size_t row) const;
+
+    /*
+     * sorts by a Column or UNSORTED. text columns compare case-insensitively
+     * in the user's locale, ties keep id order.
+     */
+    void Sort(int column, bool descending);
+    // the row displayed at `position` under the current sort.
+    size_t Row(size_t position) const;
+
+  private:
+    std::vector<int> ids;
+    std::vector<uint32_t> id_labels;
+    std::vector<uint32_t> titles;
+    std::vector<uint32_t> urls;
+    std::vector<uint32_t> categories;
+
+    std::vector<char> strings;
+    std::unordered_multimap<size_t, uint32_t> interned; // string hash -> offset
+
+    int sort_column = UNSORTED;
+    bool sort_descending = false;
+    std::vector<uint32_t> orders[COLUMN_COUNT]; // ascending, empty until needed
+
+    uint32_t append(const char* text, size_t length);
+    uint32_t intern(const std::string& text);
+    const std::vector<uint32_t>& column_offsets(int column) const;
+    void build_order(int column);
+  };
+}
+#endif
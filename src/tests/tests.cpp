@@ -2,8 +2,21 @@
 #include "doctest/doctest.h"
 #include "../database.h"
 #include "../settings.h"
+#include "../crypt.h"
+#include "../incremental_filter.h"
+#include "../table_rows.h"
+#include "../csv_importer.h"
+#include "../backup.h"
+#include "../secure_memory.h"
+#include "../database_worker.h"
+#include "../fuzzy_matcher.h"
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <random>
 
 TEST_CASE("CipherSafe::Database Close()") { 
     std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database("./test.db"));
@@ -40,3 +53,1086 @@ TEST_CASE("CipherSafe::Database Add()") {
 
     db->Close();
 }
+
+TEST_CASE("CipherSafe::Database entry cache") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database("./test.db"));
+
+    SUBCASE("Add() caches the new entry and bumps the generation") {
+		size_t cachedBefore = db->Entries().size();
+		unsigned long generationBefore = db->Generation();
+
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "cached title";
+		CHECK(db->Add(std::move(entry)) == true);
+
+		CHECK(db->Entries().size() == cachedBefore + 1);
+		CHECK(db->Generation() != generationBefore);
+		CHECK(db->Entries().back().title == "cached title");
+		CHECK(db->CachedEntry(db->Entries().back().id) != nullptr);
+    }
+
+    SUBCASE("Update() and RemoveEntryById() keep the cache in sync") {
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "before update";
+		db->Add(std::move(entry));
+
+		CipherSafe::Database::Entry updated = db->Entries().back();
+		updated.title = "after update";
+		CHECK(db->Update(&updated) == true);
+		CHECK(db->CachedEntry(updated.id)->title == "after update");
+
+		CHECK(db->RemoveEntryById(updated.id) == true);
+		CHECK(db->CachedEntry(updated.id) == nullptr);
+    }
+
+    db->Close();
+}
+
+TEST_CASE("CipherSafe::Database Search()") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database("./test.db"));
+
+    SUBCASE("matches word prefixes in title, url and category") {
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "Searchable Mailbox";
+		entry->url = "https://zqxsearch.example.com";
+		entry->category = "zqxcategory";
+		db->Add(std::move(entry));
+		int id = db->Entries().back().id;
+
+		std::vector<int> by_title = db->Search("searchable mail");
+		std::vector<int> by_url = db->Search("zqxsea");
+		std::vector<int> by_category = db->Search("ZQXCAT");
+
+		CHECK(std::find(by_title.begin(), by_title.end(), id) != by_title.end());
+		CHECK(std::find(by_url.begin(), by_url.end(), id) != by_url.end());
+		CHECK(std::find(by_category.begin(), by_category.end(), id) != by_category.end());
+
+		db->RemoveEntryById(id);
+		by_url = db->Search("zqxsea");
+		CHECK(std::find(by_url.begin(), by_url.end(), id) == by_url.end());
+    }
+
+    SUBCASE("an empty query has no results") {
+		CHECK(db->Search("").empty());
+		CHECK(db->Search("  -- ").empty());
+    }
+
+    db->Close();
+}
+
+TEST_CASE("CipherSafe::IncrementalFilter Apply()") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database("./test.db"));
+    CipherSafe::IncrementalFilter filter;
+
+    std::unique_ptr<CipherSafe::Database::Entry> first(new CipherSafe::Database::Entry());
+    first->title = "qwxgithub personal";
+    db->Add(std::move(first));
+
+    std::unique_ptr<CipherSafe::Database::Entry> second(new CipherSafe::Database::Entry());
+    second->title = "qwxgitlab work";
+    db->Add(std::move(second));
+
+    int first_id = db->Entries()[db->Entries().size() - 2].id;
+    int second_id = db->Entries().back().id;
+
+    SUBCASE("extending the query narrows the previous matches") {
+		CHECK(filter.Apply(*db, "qwxgit").size() == 2);
+		CHECK(filter.Apply(*db, "qwxgith").size() == 1);
+		CHECK(filter.Apply(*db, "qwxgith pers").size() == 1);
+		CHECK(filter.Apply(*db, "qwxgith work").empty());
+    }
+
+    SUBCASE("shortening the query searches the whole vault again") {
+		CHECK(filter.Apply(*db, "qwxgith").size() == 1);
+		CHECK(filter.Apply(*db, "qwxgi").size() == 2);
+    }
+
+    SUBCASE("matches through diacritic folding survive extending the query") {
+		std::unique_ptr<CipherSafe::Database::Entry> accented(new CipherSafe::Database::Entry());
+		accented->title = u8"qwxcafés";
+		db->Add(std::move(accented));
+		int accented_id = db->Entries().back().id;
+
+		CHECK(filter.Apply(*db, "qwxcafe").size() == 1);
+		CHECK(filter.Apply(*db, "qwxcafes").size() == 1);
+
+		db->RemoveEntryById(accented_id);
+    }
+
+    SUBCASE("a broad, unranked result is searched again once it can be ranked") {
+		std::unique_ptr<CipherSafe::Database> memory(new CipherSafe::Database(std::vector<unsigned char>()));
+		std::vector<CipherSafe::Database::Entry> batch(CipherSafe::Database::MaxRankedResults() + 10);
+
+		// the longer titles come first, so bm25 order isn't id order.
+		for (size_t i = 0; i < batch.size(); i++) {
+			batch[i].title = i < 5 ? "qwxbroadband plus a few more words" : i < 10 ? "qwxbroadband" : "qwxbroad " + std::to_string(i);
+		}
+		memory->AddBatch(batch);
+
+		CHECK(filter.Apply(*memory, "qwxbroad").size() == batch.size());
+		CHECK(filter.Apply(*memory, "qwxbroadb") == memory->Search("qwxbroadb"));
+		CHECK(memory->Search("qwxbroadb").size() == 10);
+
+		memory->Close();
+    }
+
+    db->RemoveEntryById(first_id);
+    db->RemoveEntryById(second_id);
+    db->Close();
+}
+
+TEST_CASE("CipherSafe::TableRows Add()") {
+    CipherSafe::TableRows rows;
+
+    CipherSafe::Database::Entry first = {};
+    first.id = 7;
+    first.title = "github";
+    first.url = "github.com";
+    first.category = "work";
+
+    CipherSafe::Database::Entry second = {};
+    second.id = 12345;
+    second.title = "github";
+    second.url = "gitlab.com";
+    second.category = "work";
+
+    rows.Add(first);
+    rows.Add(second);
+
+    CHECK(rows.Size() == 2);
+    CHECK(rows.Id(1) == 12345);
+    CHECK(std::string(rows.IdLabel(0)) == "7");
+    CHECK(std::string(rows.IdLabel(1)) == "12345");
+    CHECK(std::string(rows.Url(0)) == "github.com");
+    CHECK(std::string(rows.Url(1)) == "gitlab.com");
+
+    // equal strings are stored once.
+    CHECK(rows.Title(0) == rows.Title(1));
+    CHECK(rows.Category(0) == rows.Category(1));
+
+    rows.Clear();
+    CHECK(rows.Empty());
+}
+
+TEST_CASE("CipherSafe::TableRows Sort()") {
+    CipherSafe::TableRows rows;
+    const char* titles[] = { "beta", "Alpha", "gamma", "alpha" };
+
+    for (int i = 0; i < 4; i++) {
+        CipherSafe::Database::Entry entry = {};
+        entry.id = 10 - i;
+        entry.title = titles[i];
+        rows.Add(entry);
+    }
+
+    SUBCASE("text columns ignore case and break ties by id") {
+		rows.Sort(CipherSafe::TableRows::COLUMN_TITLE, false);
+		CHECK(rows.Id(rows.Row(0)) == 7); // alpha
+		CHECK(rows.Id(rows.Row(1)) == 9); // Alpha
+		CHECK(std::string(rows.Title(rows.Row(2))) == "beta");
+		CHECK(std::string(rows.Title(rows.Row(3))) == "gamma");
+
+		rows.Sort(CipherSafe::TableRows::COLUMN_TITLE, true);
+		CHECK(std::string(rows.Title(rows.Row(0))) == "gamma");
+    }
+
+    SUBCASE("ids sort numerically and UNSORTED keeps insertion order") {
+		rows.Sort(CipherSafe::TableRows::COLUMN_ID, false);
+		CHECK(rows.Id(rows.Row(0)) == 7);
+		CHECK(rows.Id(rows.Row(3)) == 10);
+
+		rows.Sort(CipherSafe::TableRows::UNSORTED, false);
+		CHECK(rows.Id(rows.Row(0)) == 10);
+    }
+
+    SUBCASE("adding rows invalidates the cached order") {
+		rows.Sort(CipherSafe::TableRows::COLUMN_ID, false);
+
+		CipherSafe::Database::Entry entry = {};
+		entry.id = 1;
+		rows.Add(entry);
+		rows.Sort(CipherSafe::TableRows::COLUMN_ID, false);
+		CHECK(rows.Id(rows.Row(0)) == 1);
+    }
+}
+
+TEST_CASE("CipherSafe::Database UpdateFields()") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database("./test.db"));
+
+    std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+    entry->title = "original title";
+    entry->password = "original password";
+    db->Add(std::move(entry));
+    int id = db->Entries().back().id;
+
+    SUBCASE("only the flagged columns are written") {
+		CipherSafe::Database::Entry edited = *db->CachedEntry(id);
+		edited.title = "edited title";
+		edited.password = "not written";
+
+		CHECK(db->UpdateFields(edited, CipherSafe::Database::FIELD_TITLE) == true);
+
+		std::unique_ptr<CipherSafe::Database::Entry> stored = db->GetEntryById(id);
+		CHECK(stored->title == "edited title");
+		CHECK(stored->password == "original password");
+		CHECK(db->CachedEntry(id)->password == "original password");
+    }
+
+    SUBCASE("a combination of columns can be written again with its cached statement") {
+		unsigned int fields = CipherSafe::Database::FIELD_URL | CipherSafe::Database::FIELD_NOTES;
+		CipherSafe::Database::Entry edited = *db->CachedEntry(id);
+
+		edited.url = "https://first.example.com";
+		edited.notes = "first";
+		CHECK(db->UpdateFields(edited, fields) == true);
+
+		edited.url = "https://second.example.com";
+		edited.notes = "second";
+		CHECK(db->UpdateFields(edited, fields) == true);
+
+		std::unique_ptr<CipherSafe::Database::Entry> stored = db->GetEntryById(id);
+		CHECK(stored->url == "https://second.example.com");
+		CHECK(stored->notes == "second");
+		CHECK(stored->title == "original title");
+    }
+
+    db->RemoveEntryById(id);
+    db->Close();
+}
+
+static std::vector<char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::vector<char>& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+}
+
+// the cheapest argon2 settings, the tests don't need to resist brute force.
+static const CipherSafe::Crypt::KdfParams FAST_KDF = { crypto_pwhash_OPSLIMIT_MIN, crypto_pwhash_MEMLIMIT_MIN };
+
+TEST_CASE("CipherSafe::Crypt encrypt_file() / decrypt_file()") {
+    const std::string work_dir = "./crypt_test/";
+    mkdir(work_dir.c_str(), 0755);
+
+    CipherSafe::Crypt crypt;
+    crypt.init(work_dir);
+    REQUIRE(crypt.create_master_password("correct horse", FAST_KDF) == true);
+
+    // a few chunks plus a partial one
+    std::vector<char> plain(3 * 1024 * 1024 + 4321);
+    randombytes_buf(plain.data(), plain.size());
+
+    SUBCASE("round trips through the chunked container") {
+		writeFile(work_dir + "core.db", plain);
+		crypt.encrypt_file();
+		CHECK(!std::ifstream(work_dir + "core.db").good());
+
+		crypt.decrypt_file();
+		CHECK(readFile(work_dir + "core.db") == plain);
+    }
+
+    SUBCASE("the in-memory path never writes plaintext to disk") {
+		CHECK(crypt.encrypt_from_memory(reinterpret_cast<const unsigned char*>(plain.data()), plain.size()) == true);
+
+		std::vector<unsigned char> decrypted;
+		CHECK(crypt.decrypt_to_memory(decrypted) == true);
+		CHECK(std::equal(decrypted.begin(), decrypted.end(), reinterpret_cast<const unsigned char*>(plain.data())));
+		CHECK(decrypted.size() == plain.size());
+		CHECK(!std::ifstream(work_dir + "core.db").good());
+		CHECK(std::ifstream(work_dir + "core.enc").good());
+    }
+
+    SUBCASE("the mapped and buffered backends read each other's files") {
+		writeFile(work_dir + "core.db", plain);
+		crypt.encrypt_file();
+
+		crypt.set_io_backend(CipherSafe::Crypt::IO_BUFFERED);
+		crypt.decrypt_file();
+		CHECK(readFile(work_dir + "core.db") == plain);
+		crypt.encrypt_file();
+
+		crypt.set_io_backend(CipherSafe::Crypt::IO_MMAP);
+		crypt.decrypt_file();
+		CHECK(readFile(work_dir + "core.db") == plain);
+    }
+
+    SUBCASE("every save gets fresh nonces and replaces the file atomically") {
+		const unsigned char* data = reinterpret_cast<const unsigned char*>(plain.data());
+
+		CHECK(crypt.encrypt_from_memory(data, plain.size()) == true);
+		std::vector<char> first = readFile(work_dir + "core.enc");
+		CHECK(crypt.encrypt_from_memory(data, plain.size()) == true);
+		std::vector<char> second = readFile(work_dir + "core.enc");
+
+		// same header, but no nonce (and so no ciphertext) is ever reused.
+		CHECK(first.size() == second.size());
+		CHECK(std::equal(first.begin(), first.begin() + 32, second.begin()));
+		CHECK(!std::equal(first.begin() + 32, first.begin() + 32 + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, second.begin() + 32));
+		CHECK(!std::ifstream(work_dir + "core.enc.tmp").good());
+		CHECK(!std::ifstream(work_dir + ".encryption_header.bin").good());
+    }
+
+    SUBCASE("a tampered chunk is rejected") {
+		writeFile(work_dir + "core.db", plain);
+		crypt.encrypt_file();
+
+		std::vector<char> encrypted = readFile(work_dir + "core.enc");
+		encrypted[encrypted.size() / 2] ^= 0x01;
+		writeFile(work_dir + "core.enc", encrypted);
+
+		crypt.decrypt_file();
+		CHECK(!std::ifstream(work_dir + "core.db").good());
+    }
+
+    SUBCASE("a truncated legacy key file isn't adopted or deleted") {
+		std::remove((work_dir + "core.vault.key").c_str());
+		writeFile(work_dir + ".encryption_key.bin", std::vector<char>(10, 'k'));
+
+		CipherSafe::Crypt crypt;
+		crypt.init(work_dir);
+		CHECK(crypt.create_master_password("correct horse", FAST_KDF) == false);
+		CHECK(crypt.has_master_password() == false);
+		CHECK(readFile(work_dir + ".encryption_key.bin") == std::vector<char>(10, 'k'));
+
+		std::remove((work_dir + ".encryption_key.bin").c_str());
+    }
+
+    SUBCASE("vaults in the legacy secretstream format still decrypt") {
+		// an install from before master passwords: a raw key file and no key header.
+		std::remove((work_dir + "core.vault.key").c_str());
+
+		unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+		crypto_secretstream_xchacha20poly1305_keygen(key);
+		writeFile(work_dir + ".encryption_key.bin", std::vector<char>(key, key + sizeof(key)));
+
+		CipherSafe::Crypt crypt;
+		crypt.init(work_dir);
+		REQUIRE(crypt.create_master_password("correct horse", FAST_KDF) == true);
+		CHECK(!std::ifstream(work_dir + ".encryption_key.bin").good());
+
+		crypto_secretstream_xchacha20poly1305_state state;
+		unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+		crypto_secretstream_xchacha20poly1305_init_push(&state, header, key);
+
+		std::ofstream legacy(work_dir + "core.enc", std::ios::binary);
+		legacy.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+		std::vector<unsigned char> buf(4096 + crypto_secretstream_xchacha20poly1305_ABYTES);
+		for (size_t offset = 0; offset < plain.size(); offset += 4096) {
+			size_t len = std::min<size_t>(4096, plain.size() - offset);
+			unsigned char tag = offset + len == plain.size() ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : 0;
+			unsigned long long out_len;
+			crypto_secretstream_xchacha20poly1305_push(&state, buf.data(), &out_len, reinterpret_cast<const unsigned char*>(plain.data()) + offset, len, nullptr, 0, tag);
+			legacy.write(reinterpret_cast<const char*>(buf.data()), out_len);
+		}
+		legacy.close();
+
+		crypt.decrypt_file();
+		CHECK(readFile(work_dir + "core.db") == plain);
+    }
+
+    std::remove((work_dir + "core.db").c_str());
+    std::remove((work_dir + "core.enc").c_str());
+    std::remove((work_dir + "core.vault.key").c_str());
+}
+
+TEST_CASE("CipherSafe::Crypt master password") {
+    const std::string work_dir = "./crypt_test/";
+    mkdir(work_dir.c_str(), 0755);
+
+    CipherSafe::Crypt crypt;
+    crypt.init(work_dir);
+    CHECK(crypt.has_master_password() == false);
+    REQUIRE(crypt.create_master_password("correct horse", FAST_KDF) == true);
+    CHECK(crypt.has_master_password() == true);
+    CHECK(crypt.create_master_password("another one", FAST_KDF) == false);
+
+    unsigned char page_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+    crypt.derive_page_key(page_key);
+
+    SUBCASE("the right password unlocks the same key, a wrong one nothing") {
+		CipherSafe::Crypt wrong;
+		wrong.init(work_dir);
+		CHECK(wrong.unlock("battery staple", FAST_KDF) == false);
+		CHECK(wrong.unlocked() == false);
+
+		CipherSafe::Crypt right;
+		right.init(work_dir);
+		CHECK(right.unlock("correct horse", FAST_KDF) == true);
+		CHECK(right.unlocked() == true);
+
+		unsigned char unlocked_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+		right.derive_page_key(unlocked_key);
+		CHECK(std::memcmp(page_key, unlocked_key, sizeof(page_key)) == 0);
+    }
+
+    SUBCASE("new parameters re-wrap the key, tampered ones are rejected") {
+		const CipherSafe::Crypt::KdfParams slower = { crypto_pwhash_OPSLIMIT_MIN + 1, crypto_pwhash_MEMLIMIT_MIN * 2 };
+
+		CipherSafe::Crypt rewrapped;
+		rewrapped.init(work_dir);
+		CHECK(rewrapped.unlock("correct horse", slower) == true);
+
+		std::vector<char> header = readFile(work_dir + "core.vault.key");
+		REQUIRE(header.size() > 32);
+		CHECK(static_cast<unsigned char>(header[16]) == slower.opslimit);
+
+		CipherSafe::Crypt again;
+		again.init(work_dir);
+		CHECK(again.unlock("correct horse", slower) == true);
+
+		// the parameters are authenticated: lowering them breaks the unlock.
+		header[16] = static_cast<char>(crypto_pwhash_OPSLIMIT_MIN);
+		writeFile(work_dir + "core.vault.key", header);
+
+		CipherSafe::Crypt tampered;
+		tampered.init(work_dir);
+		CHECK(tampered.unlock("correct horse", slower) == false);
+    }
+
+    SUBCASE("calibration stays within the presets it scales from") {
+		double seconds = 0;
+		CipherSafe::Crypt::KdfParams params = CipherSafe::Crypt::calibrate_kdf(0.05, &seconds);
+		CHECK(seconds > 0);
+		CHECK(params.opslimit >= crypto_pwhash_OPSLIMIT_INTERACTIVE);
+		CHECK(params.memlimit >= crypto_pwhash_MEMLIMIT_INTERACTIVE);
+		CHECK(params.memlimit <= crypto_pwhash_MEMLIMIT_SENSITIVE);
+    }
+
+    std::remove((work_dir + "core.vault.key").c_str());
+}
+
+TEST_CASE("CipherSafe::Database in-memory image") {
+    SUBCASE("a serialized image opens with the same entries") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(std::vector<unsigned char>()));
+
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "in memory";
+		db->Add(std::move(entry));
+
+		std::vector<unsigned char> image;
+		CHECK(db->Serialize([&image](const unsigned char* data, size_t size) {
+			image.assign(data, data + size);
+			return true;
+		}) == true);
+		db->Close();
+
+		std::unique_ptr<CipherSafe::Database> reopened(new CipherSafe::Database(image));
+		CHECK(reopened->Entries().size() == 1);
+		CHECK(reopened->Entries().back().title == "in memory");
+		CHECK(reopened->Search("memory").size() == 1);
+		reopened->Close();
+    }
+}
+
+TEST_CASE("CipherSafe::Database encrypted vault") {
+    const std::string vault_path = "./vault_test.db";
+    unsigned char key[CipherSafe::EncryptedVFS::KEY_BYTES];
+    randombytes_buf(key, sizeof(key));
+
+    SUBCASE("entries survive a reopen and never hit the disk in plaintext") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, key));
+
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "encrypted page";
+		entry->password = "hunter2hunter2";
+		CHECK(db->Add(std::move(entry)) == true);
+		CHECK(db->Close() == 0);
+
+		std::vector<char> raw = readFile(vault_path);
+		std::string needle = "hunter2hunter2";
+		CHECK(raw.size() % CipherSafe::EncryptedVFS::PAGE_SIZE == 0);
+		CHECK(std::search(raw.begin(), raw.end(), needle.begin(), needle.end()) == raw.end());
+
+		std::unique_ptr<CipherSafe::Database> reopened(new CipherSafe::Database(vault_path, key));
+		CHECK(reopened->Entries().size() == 1);
+		CHECK(reopened->Entries().back().password == "hunter2hunter2");
+		CHECK(reopened->Search("encrypted").size() == 1);
+		reopened->Close();
+    }
+
+    SUBCASE("the wrong key doesn't open the vault") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, key));
+		db->Close();
+
+		unsigned char wrong_key[CipherSafe::EncryptedVFS::KEY_BYTES];
+		randombytes_buf(wrong_key, sizeof(wrong_key));
+		CHECK_THROWS(CipherSafe::Database(vault_path, wrong_key));
+    }
+
+    SUBCASE("a vault that fails to open doesn't keep its key") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, key));
+		db->Close();
+
+		// a newer schema is only noticed after the vault has been decrypted.
+		sqlite3* raw = nullptr;
+		CipherSafe::EncryptedVFS::SetKey(vault_path, key);
+		REQUIRE(sqlite3_open_v2(vault_path.c_str(), &raw, SQLITE_OPEN_READWRITE, CipherSafe::EncryptedVFS::NAME) == SQLITE_OK);
+		std::string sql = "PRAGMA user_version = " + std::to_string(CipherSafe::Database::LatestSchemaVersion() + 1) + ";";
+		CHECK(sqlite3_exec(raw, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK);
+		sqlite3_close(raw);
+
+		CHECK_THROWS(CipherSafe::Database(vault_path, key));
+
+		raw = nullptr;
+		CHECK(sqlite3_open_v2(vault_path.c_str(), &raw, SQLITE_OPEN_READWRITE, CipherSafe::EncryptedVFS::NAME) != SQLITE_OK);
+		sqlite3_close(raw);
+    }
+
+    SUBCASE("Import() copies a legacy image") {
+		std::unique_ptr<CipherSafe::Database> legacy(new CipherSafe::Database(std::vector<unsigned char>()));
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "from core.enc";
+		legacy->Add(std::move(entry));
+
+		std::vector<unsigned char> image;
+		legacy->Serialize([&image](const unsigned char* data, size_t size) {
+			image.assign(data, data + size);
+			return true;
+		});
+		legacy->Close();
+
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, key));
+		CHECK(db->Entries().size() == 0);
+		CHECK(db->Import(image) == true);
+		CHECK(db->Entries().size() == 1);
+		CHECK(db->Search("core").size() == 1);
+		db->Close();
+    }
+
+    SUBCASE("commits sitting in the WAL are encrypted too") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(vault_path, key, CipherSafe::Database::StorageProfile("balanced")));
+		CHECK(db->Pragma("journal_mode") == "wal");
+
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "in the wal";
+		entry->password = "hunter3hunter3";
+		CHECK(db->Add(std::move(entry)) == true);
+
+		std::vector<char> wal = readFile(vault_path + "-wal");
+		std::string needle = "hunter3hunter3";
+		CHECK(wal.size() > 0);
+		CHECK(std::search(wal.begin(), wal.end(), needle.begin(), needle.end()) == wal.end());
+		db->Close();
+
+		std::unique_ptr<CipherSafe::Database> reopened(new CipherSafe::Database(vault_path, key));
+		CHECK(reopened->Entries().size() == 1);
+		CHECK(reopened->Entries().back().password == "hunter3hunter3");
+		reopened->Close();
+    }
+
+    std::remove(vault_path.c_str());
+    std::remove((vault_path + "-wal").c_str());
+    std::remove((vault_path + "-shm").c_str());
+}
+
+TEST_CASE("CipherSafe::Database StorageProfile()") {
+    const std::string db_path = "./storage_test.db";
+
+    SUBCASE("the profiles trade syncing for speed") {
+		CHECK(CipherSafe::Database::StorageProfile("safe").synchronous == "FULL");
+		CHECK(CipherSafe::Database::StorageProfile("balanced").synchronous == "NORMAL");
+		CHECK(CipherSafe::Database::StorageProfile("fast").synchronous == "OFF");
+		CHECK(CipherSafe::Database::StorageProfile("unknown").synchronous == "FULL");
+    }
+
+    SUBCASE("the pragmas are applied at open") {
+		CipherSafe::Database::StorageParams storage = CipherSafe::Database::StorageProfile("balanced");
+		storage.page_size = 8192;
+		storage.cache_size = -4096;
+
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(db_path, storage));
+		CHECK(db->Pragma("journal_mode") == "wal");
+		CHECK(db->Pragma("synchronous") == "1");
+		CHECK(db->Pragma("page_size") == "8192");
+		CHECK(db->Pragma("cache_size") == "-4096");
+		CHECK(db->Pragma("temp_store") == "2");
+		db->Close();
+    }
+
+    SUBCASE("a rollback journal is still available") {
+		CipherSafe::Database::StorageParams storage;
+		storage.journal_mode = "DELETE";
+
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(db_path, storage));
+		CHECK(db->Pragma("journal_mode") == "delete");
+		CHECK(db->Pragma("synchronous") == "2");
+		db->Close();
+    }
+
+    std::remove(db_path.c_str());
+    std::remove((db_path + "-wal").c_str());
+    std::remove((db_path + "-shm").c_str());
+}
+
+TEST_CASE("CipherSafe::Database migrations") {
+    const std::string db_path = "./migration_test.db";
+
+    SUBCASE("a new vault starts at the latest schema with its indexes") {
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(db_path));
+		CHECK(db->SchemaVersion() == CipherSafe::Database::LatestSchemaVersion());
+		CHECK(db->Pragma("index_info(secrets_category)").empty() == false);
+		CHECK(db->Pragma("index_info(secrets_url)").empty() == false);
+		db->Close();
+    }
+
+    SUBCASE("a vault from before migrations is upgraded in place") {
+		sqlite3* raw = nullptr;
+		REQUIRE(sqlite3_open(db_path.c_str(), &raw) == SQLITE_OK);
+		CHECK(sqlite3_exec(raw,
+			"CREATE TABLE secrets (id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT, url TEXT, username TEXT, password TEXT, category TEXT, notes TEXT);"
+			"INSERT INTO secrets (title, url, category) VALUES ('old entry', 'https://example.com', 'legacy');",
+			nullptr, nullptr, nullptr) == SQLITE_OK);
+		sqlite3_close(raw);
+
+		std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(db_path));
+		CHECK(db->SchemaVersion() == CipherSafe::Database::LatestSchemaVersion());
+		CHECK(db->Pragma("index_info(secrets_category)").empty() == false);
+		REQUIRE(db->Entries().size() == 1);
+		CHECK(db->Entries().back().title == "old entry");
+		CHECK(db->Search("legacy").size() == 1);
+		db->Close();
+    }
+
+    SUBCASE("a vault from a newer version isn't opened") {
+		sqlite3* raw = nullptr;
+		REQUIRE(sqlite3_open(db_path.c_str(), &raw) == SQLITE_OK);
+		std::string sql = "PRAGMA user_version = " + std::to_string(CipherSafe::Database::LatestSchemaVersion() + 1) + ";";
+		CHECK(sqlite3_exec(raw, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK);
+		sqlite3_close(raw);
+
+		std::unique_ptr<CipherSafe::Database> db;
+		CHECK_THROWS(db.reset(new CipherSafe::Database(db_path)));
+
+		// nothing was created in it either.
+		REQUIRE(sqlite3_open(db_path.c_str(), &raw) == SQLITE_OK);
+		sqlite3_stmt* stmt = nullptr;
+		REQUIRE(sqlite3_prepare_v2(raw, "SELECT count(*) FROM sqlite_master;", -1, &stmt, nullptr) == SQLITE_OK);
+		REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+		CHECK(sqlite3_column_int(stmt, 0) == 0);
+		sqlite3_finalize(stmt);
+		sqlite3_close(raw);
+    }
+
+    std::remove(db_path.c_str());
+    std::remove((db_path + "-wal").c_str());
+    std::remove((db_path + "-shm").c_str());
+}
+
+TEST_CASE("CipherSafe::Database AddBatch()") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(std::vector<unsigned char>()));
+
+    std::vector<CipherSafe::Database::Entry> batch(10000);
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i].title = "batch " + std::to_string(i);
+        batch[i].category = "imported";
+    }
+
+    SUBCASE("every entry is inserted, cached and searchable") {
+		size_t reported = 0;
+		CHECK(db->AddBatch(batch, [&reported](size_t added) { reported = added; return true; }) == true);
+		CHECK(reported == batch.size());
+		CHECK(db->Entries().size() == batch.size());
+		CHECK(db->Entries().back().title == "batch 9999");
+		CHECK(db->GetEntryById(db->Entries().front().id)->title == "batch 0");
+		CHECK(db->Search("imported").size() == batch.size());
+    }
+
+    SUBCASE("cancelling from the progress callback keeps nothing") {
+		CHECK(db->AddBatch(batch, [](size_t) { return false; }) == false);
+		CHECK(db->Entries().empty());
+		CHECK(db->GetAll().empty());
+    }
+
+    db->Close();
+}
+
+TEST_CASE("CipherSafe::DatabaseWorker") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(std::vector<unsigned char>()));
+    CipherSafe::DatabaseWorker worker(std::move(db));
+
+    SUBCASE("commands run in order, the mirror only changes in Drain()") {
+		std::vector<int> ids;
+		for (int i = 0; i < 2; i++) {
+			std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+			entry->title = "worker " + std::to_string(i);
+			worker.Add(std::move(entry), [&ids](const CipherSafe::DatabaseWorker::Result& result) {
+				CHECK(result.ok == true);
+				ids.push_back(result.id);
+			});
+		}
+
+		worker.Wait();
+		CHECK(worker.Entries().empty());
+		CHECK(worker.Busy() == true);
+		unsigned long generation = worker.Generation();
+
+		CHECK(worker.Drain() == 2);
+		CHECK(worker.Busy() == false);
+		REQUIRE(ids.size() == 2);
+		REQUIRE(worker.Entries().size() == 2);
+		CHECK(worker.Generation() > generation);
+
+		CipherSafe::Database::Entry edited = *worker.CachedEntry(ids[0]);
+		edited.title = "edited";
+		worker.UpdateFields(edited, CipherSafe::Database::FIELD_TITLE);
+		worker.RemoveEntryById(ids[1]);
+
+		std::vector<int> found;
+		worker.Search("edited", [&found](const CipherSafe::DatabaseWorker::Result& result) { found = result.ids; });
+
+		worker.Wait();
+		CHECK(worker.Drain() == 3);
+		REQUIRE(worker.Entries().size() == 1);
+		CHECK(worker.CachedEntry(ids[0])->title == "edited");
+		CHECK(worker.CachedEntry(ids[1]) == nullptr);
+		CHECK(found == std::vector<int>{ ids[0] });
+    }
+
+    SUBCASE("several threads can post at once") {
+		std::vector<std::thread> producers;
+		for (int t = 0; t < 4; t++) {
+			producers.push_back(std::thread([&worker, t]() {
+				for (int i = 0; i < 250; i++) {
+					std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+					entry->title = "thread " + std::to_string(t) + " entry " + std::to_string(i);
+					worker.Add(std::move(entry));
+				}
+			}));
+		}
+		for (auto& producer : producers) {
+			producer.join();
+		}
+
+		worker.Wait();
+		CHECK(worker.Drain() == 1000);
+		CHECK(worker.Entries().size() == 1000);
+		CHECK(std::is_sorted(worker.Entries().begin(), worker.Entries().end(),
+			[](const CipherSafe::Database::Entry& a, const CipherSafe::Database::Entry& b) { return a.id < b.id; }));
+    }
+
+    SUBCASE("Close() runs what is still queued") {
+		bool ran = false;
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->title = "last one";
+		worker.Add(std::move(entry), [&ran](const CipherSafe::DatabaseWorker::Result& result) { ran = result.ok; });
+
+		worker.Close();
+		CHECK(ran == true);
+		CHECK(worker.Entries().size() == 1);
+    }
+}
+
+TEST_CASE("CipherSafe::CategoryIndex") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(std::vector<unsigned char>()));
+
+    const char* categories[] = { "email", "finance", "email", "" };
+    for (const char* category : categories) {
+        std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+        entry->title = std::string("in ") + category;
+        entry->category = category;
+        db->Add(std::move(entry));
+    }
+    std::vector<int> ids;
+    for (const auto& entry : db->Entries()) {
+        ids.push_back(entry.id);
+    }
+
+    SUBCASE("counts and ids follow Add/UpdateFields/RemoveEntryById") {
+		const CipherSafe::CategoryIndex& index = db->Categories();
+		CHECK(index.Categories().size() == 3);
+		CHECK(index.Count("email") == 2);
+		CHECK(*index.Ids("email") == (std::vector<int>{ ids[0], ids[2] }));
+		CHECK(index.Count("") == 1);
+		CHECK(index.Ids("social") == nullptr);
+
+		CipherSafe::Database::Entry moved = *db->CachedEntry(ids[0]);
+		moved.category = "finance";
+		db->UpdateFields(moved, CipherSafe::Database::FIELD_CATEGORY);
+		CHECK(index.Count("email") == 1);
+		CHECK(*index.Ids("finance") == (std::vector<int>{ ids[0], ids[1] }));
+
+		db->RemoveEntryById(ids[2]);
+		CHECK(index.Ids("email") == nullptr);
+		CHECK(index.Categories().size() == 2);
+    }
+
+    SUBCASE("the worker's mirror keeps its own index") {
+		CipherSafe::DatabaseWorker worker(std::move(db));
+		CHECK(worker.Categories().Count("email") == 2);
+
+		std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+		entry->category = "social";
+		worker.Add(std::move(entry));
+		worker.RemoveEntryById(ids[1]);
+		worker.Wait();
+
+		CHECK(worker.Categories().Count("social") == 0);
+		worker.Drain();
+		CHECK(worker.Categories().Count("social") == 1);
+		CHECK(worker.Categories().Ids("finance") == nullptr);
+		worker.Close();
+    }
+
+    if (db) {
+        db->Close();
+    }
+}
+
+static bool isSubsequence(const std::string& text, const std::string& term) {
+    size_t j = 0;
+    for (size_t i = 0; i < text.size() && j < term.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(text[i])) == term[j]) {
+            j++;
+        }
+    }
+    return j == term.size();
+}
+
+TEST_CASE("CipherSafe::FuzzyMatcher Search()") {
+    std::vector<CipherSafe::Database::Entry> entries(5);
+    const char* titles[] = { "GitHub", "GitLab", "Digital Ocean", "Bank of Examples", "Mail" };
+    const char* urls[] = { "https://github.com", "https://gitlab.com", "https://cloud.digitalocean.com/login", "https://bank.example.com", "" };
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].id = static_cast<int>(i) + 1;
+        entries[i].title = titles[i];
+        entries[i].url = urls[i];
+    }
+    entries[4].username = "Alice.Longer.Than.Thirty.Two.Bytes@example.org";
+
+    CipherSafe::FuzzyMatcher matcher;
+    matcher.Build(entries);
+    CHECK(matcher.Size() == entries.size());
+
+    SUBCASE("word starts and runs rank first") {
+		std::vector<CipherSafe::FuzzyMatcher::Match> matches = matcher.Search("gh", 10);
+		REQUIRE(matches.size() >= 1);
+		CHECK(matches[0].id == 1);
+
+		matches = matcher.Search("git", 10);
+		REQUIRE(matches.size() >= 3);
+		CHECK(matches[2].id == 3); // "digital" only has it mid word
+    }
+
+    SUBCASE("missing, swapped and extra letters") {
+		CHECK(matcher.Search("gthub", 10).at(0).id == 1);
+		CHECK(matcher.Search("githbu", 10).at(0).id == 1);
+		CHECK(matcher.Search("GITHUBB", 10).at(0).id == 1);
+		CHECK(matcher.Search("xq", 10).empty());
+    }
+
+    SUBCASE("every term has to match, usernames and long fields included") {
+		std::vector<CipherSafe::FuzzyMatcher::Match> matches = matcher.Search("alice example.org", 10);
+		REQUIRE(matches.size() == 1);
+		CHECK(matches[0].id == 5);
+
+		CHECK(matcher.Search("bank zzz", 10).empty());
+		CHECK(matcher.Search("git", 2).size() == 2);
+		CHECK(matcher.Search("   ", 10).empty());
+    }
+
+    SUBCASE("short terms find exactly the subsequence matches") {
+		std::mt19937 rng(7);
+		std::vector<CipherSafe::Database::Entry> random(500);
+		for (size_t i = 0; i < random.size(); i++) {
+			random[i].id = static_cast<int>(i) + 1;
+			for (size_t c = rng() % 80; c > 0; c--) {
+				random[i].title += static_cast<char>("abcdeXYZ .-"[rng() % 11]);
+			}
+		}
+		matcher.Build(random);
+
+		const char* terms[] = { "a", "xz", "bad" };
+		for (const char* term : terms) {
+			size_t expected = 0;
+			for (const auto& entry : random) {
+				expected += isSubsequence(entry.title, term) ? 1 : 0;
+			}
+
+			// positive scores only, but short matches in short strings are never that scattered.
+			CHECK(matcher.Search(term, random.size()).size() <= expected);
+			CHECK(matcher.Search(term, random.size()).size() + 10 >= expected);
+		}
+
+		// a small limit skips entries that can't make it, the ones it keeps are the same.
+		const char* queries[] = { "a", "bad", "abcde", "dcba xyz" };
+		for (const char* query : queries) {
+			std::vector<CipherSafe::FuzzyMatcher::Match> all = matcher.Search(query, random.size());
+			std::vector<CipherSafe::FuzzyMatcher::Match> top = matcher.Search(query, 5);
+
+			REQUIRE(top.size() == std::min<size_t>(5, all.size()));
+			for (size_t i = 0; i < top.size(); i++) {
+				CHECK(top[i].id == all[i].id);
+				CHECK(top[i].score == all[i].score);
+			}
+		}
+    }
+}
+
+TEST_CASE("CipherSafe::CsvImporter Next()") {
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(std::vector<unsigned char>()));
+
+    SUBCASE("header aliases, quoting and blank lines") {
+		std::istringstream csv(
+			"\xEF\xBB\xBFname,login_uri,login_username,login_password,folder,extra,totp\r\n"
+			"GitHub,https://github.com,octo,\"pa,ss\"\"word\",dev,\"line one\nline two\",123456\r\n"
+			"\r\n"
+			"Bank,https://bank.example,me,hunter2,finance,,\n");
+
+		CipherSafe::CsvImporter importer(csv);
+		CHECK(db->AddBatch(importer.Source()) == true);
+		REQUIRE(db->Entries().size() == 2);
+
+		const CipherSafe::Database::Entry& github = db->Entries()[0];
+		CHECK(github.title == "GitHub");
+		CHECK(github.url == "https://github.com");
+		CHECK(github.username == "octo");
+		CHECK(github.password == "pa,ss\"word");
+		CHECK(github.category == "dev");
+		CHECK(github.notes == "line one\nline two");
+		CHECK(db->Entries()[1].title == "Bank");
+    }
+
+    SUBCASE("malformed input rolls the whole batch back") {
+		std::istringstream csv(
+			"title,password\n"
+			"first,one\n"
+			"second,\"never closed\n");
+
+		CipherSafe::CsvImporter importer(csv);
+		CHECK(db->AddBatch(importer.Source()) == false);
+		CHECK(!importer.Error().empty());
+		CHECK(db->Entries().empty());
+    }
+
+    db->Close();
+}
+
+TEST_CASE("CipherSafe::Backup Start()") {
+    const std::string work_dir = "./crypt_test/";
+    const std::string backup_dir = work_dir + "backups/";
+    mkdir(work_dir.c_str(), 0755);
+    mkdir(backup_dir.c_str(), 0700);
+
+    CipherSafe::Crypt crypt;
+    crypt.init(work_dir);
+    REQUIRE(crypt.create_master_password("correct horse", FAST_KDF) == true);
+
+    unsigned char key[CipherSafe::EncryptedVFS::KEY_BYTES];
+    crypt.derive_page_key(key);
+    std::unique_ptr<CipherSafe::Database> db(new CipherSafe::Database(crypt.vault_path(), key));
+
+    std::unique_ptr<CipherSafe::Database::Entry> entry(new CipherSafe::Database::Entry());
+    entry->title = "backed up";
+    entry->password = "hunter2hunter2";
+    db->Add(std::move(entry));
+
+    // older backups that retention should rotate out.
+    const char* old_backups[] = { "ciphersafe-20000101-000000.enc", "ciphersafe-20000102-000000.enc" };
+    for (const char* name : old_backups) {
+        writeFile(backup_dir + name, std::vector<char>(16));
+    }
+
+    std::atomic<int> wakes(0);
+    CipherSafe::Backup backup(crypt, [&wakes]() { wakes++; });
+    CHECK(backup.Start(crypt.vault_path(), backup_dir, 2) == true);
+    backup.Wait();
+    CHECK(wakes == 1);
+
+    std::string message;
+    CHECK(backup.Poll(message) == true);
+    CHECK(message.find("backed up") == 0);
+    CHECK(backup.Running() == false);
+    CHECK(backup.Poll(message) == false);
+
+    CHECK(!std::ifstream(backup_dir + old_backups[0]).good());
+    CHECK(std::ifstream(backup_dir + old_backups[1]).good());
+
+    std::string filename = message.substr(message.find(backup_dir));
+    filename.erase(filename.size() - 3); // trailing "..."
+
+    std::vector<unsigned char> image;
+    CHECK(crypt.decrypt_from_file(filename, image) == true);
+
+    std::unique_ptr<CipherSafe::Database> restored(new CipherSafe::Database(image));
+    CHECK(restored->Entries().size() == 1);
+    CHECK(restored->Entries().back().password == "hunter2hunter2");
+    restored->Close();
+
+    // a second backup straight after the first gets its own file.
+    CHECK(backup.Start(crypt.vault_path(), backup_dir, 2) == true);
+    backup.Wait();
+    CHECK(backup.Poll(message) == true);
+
+    std::string second = message.substr(message.find(backup_dir));
+    second.erase(second.size() - 3);
+    CHECK(second != filename);
+    CHECK(std::ifstream(filename).good());
+    CHECK(std::ifstream(second).good());
+
+    db->Close();
+    std::remove(filename.c_str());
+    std::remove(second.c_str());
+    std::remove((backup_dir + old_backups[1]).c_str());
+    std::remove(backup_dir.c_str());
+    std::remove(crypt.vault_path().c_str());
+    std::remove((work_dir + "core.vault.key").c_str());
+}
+
+TEST_CASE("CipherSafe::SecureString") {
+    CipherSafe::SecureArena& arena = CipherSafe::SecureArena::Session();
+
+    SUBCASE("behaves like a string") {
+		CipherSafe::SecureString password("hunter2");
+		CHECK(password == "hunter2");
+		CHECK(password.size() == 7);
+		CHECK(std::string(password.c_str()) == "hunter2");
+
+		password.append("hunter2", 7);
+		password += '!';
+		CHECK(password == "hunter2hunter2!");
+
+		CipherSafe::SecureString copy = password;
+		password.resize(3);
+		CHECK(password == "hun");
+		CHECK(copy == std::string("hunter2hunter2!"));
+
+		password.clear();
+		CHECK(password.empty());
+		CHECK(std::string(password.c_str()).empty());
+		CHECK(CipherSafe::SecureString() == "");
+    }
+
+    SUBCASE("released chunks are wiped and reused") {
+		size_t in_use = arena.BytesInUse();
+		const char* chunk = nullptr;
+
+		{
+			CipherSafe::SecureString secret("hunter2hunter2");
+			chunk = secret.c_str();
+		}
+		CHECK(arena.BytesInUse() == in_use);
+		CHECK(std::string(chunk).empty());
+
+		size_t reserved = arena.BytesReserved();
+		for (int i = 0; i < 10000; i++) {
+			CipherSafe::SecureString secret(CipherSafe::Crypt::random_string(1 + i % 300));
+		}
+		// 10000 strings without recycling would need several blocks.
+		CHECK(arena.BytesReserved() <= reserved + CipherSafe::SecureArena::BLOCK_SIZE);
+    }
+
+    SUBCASE("strings bigger than a chunk get their own allocation") {
+		std::string notes(CipherSafe::SecureArena::MAX_CHUNK * 2, 'n');
+		size_t reserved = arena.BytesReserved();
+		{
+			CipherSafe::SecureString secret(notes);
+			CHECK(secret == notes);
+			CHECK(arena.BytesReserved() > reserved);
+		}
+		CHECK(arena.BytesReserved() == reserved);
+    }
+}